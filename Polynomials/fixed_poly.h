@@ -0,0 +1,208 @@
+#ifndef FIXED_POLY
+#define FIXED_POLY
+
+#include <type_traits>
+#include <stdexcept>
+#include <string>
+
+template <typename T, int N>
+class fixed_poly {
+	static_assert(N > 0, "fixed_poly needs at least one coefficient");
+
+private:
+	T _coeff[N];
+
+	template <int I>
+	constexpr T horner(T, std::integral_constant<int, I>) const;
+	constexpr T horner(T, std::integral_constant<int, N-1>) const;
+
+	template <int B, int E>
+	constexpr T estrin(T, std::true_type) const;
+	template <int B, int E>
+	constexpr T estrin(T, std::false_type) const;
+
+	template <int K>
+	static constexpr T power(T, std::integral_constant<int, K>);
+	static constexpr T power(T, std::integral_constant<int, 1>);
+
+	template <typename U, int M>
+	friend class fixed_poly;
+
+public:
+	static constexpr int size = N;
+
+	constexpr fixed_poly();
+
+	template <typename... Args>
+	constexpr explicit fixed_poly(T, Args...);
+
+	constexpr T operator[](int) const;
+
+	template <int M>
+	constexpr fixed_poly<T, (N > M ? N : M)> operator+(const fixed_poly<T, M>&) const;
+
+	template <int M>
+	constexpr fixed_poly<T, (N > M ? N : M)> operator-(const fixed_poly<T, M>&) const;
+
+	template <int M>
+	constexpr fixed_poly<T, N+M-1> operator*(const fixed_poly<T, M>&) const;
+
+	constexpr fixed_poly operator*(T) const;
+	constexpr fixed_poly operator-() const;
+
+	constexpr T operator()(T) const;
+	constexpr T estrin(T) const;
+
+	template <typename P>
+	P to() const;
+
+	template <typename P>
+	static fixed_poly from(const P&);
+};
+
+template <typename T, int N>
+constexpr int fixed_poly<T, N>::size;
+
+template <typename T, int N>
+constexpr fixed_poly<T, N>::fixed_poly() :
+_coeff{}
+{ }
+
+template <typename T, int N>
+template <typename... Args>
+constexpr fixed_poly<T, N>::fixed_poly(T c0, Args... rest) :
+_coeff{c0, static_cast<T>(rest)...}
+{
+	static_assert(sizeof...(Args) < N, "too many coefficients for fixed_poly");
+}
+
+template <typename T, int N>
+constexpr T fixed_poly<T, N>::operator[](int i) const {
+	return i >= 0 && i < N ? _coeff[i] : T();
+}
+
+template <typename T, int N>
+template <int M>
+constexpr fixed_poly<T, (N > M ? N : M)>
+fixed_poly<T, N>::operator+(const fixed_poly<T, M>& argp) const {
+	fixed_poly<T, (N > M ? N : M)> new_poly;
+	for (int i = 0; i < new_poly.size; ++i)
+		new_poly._coeff[i] = (*this)[i] + argp[i];
+
+	return new_poly;
+}
+
+template <typename T, int N>
+template <int M>
+constexpr fixed_poly<T, (N > M ? N : M)>
+fixed_poly<T, N>::operator-(const fixed_poly<T, M>& argp) const {
+	fixed_poly<T, (N > M ? N : M)> new_poly;
+	for (int i = 0; i < new_poly.size; ++i)
+		new_poly._coeff[i] = (*this)[i] - argp[i];
+
+	return new_poly;
+}
+
+template <typename T, int N>
+template <int M>
+constexpr fixed_poly<T, N+M-1>
+fixed_poly<T, N>::operator*(const fixed_poly<T, M>& argp) const {
+	fixed_poly<T, N+M-1> new_poly;
+	for (int i = 0; i < N; ++i)
+		for (int j = 0; j < M; ++j)
+			new_poly._coeff[i+j] += _coeff[i] * argp._coeff[j];
+
+	return new_poly;
+}
+
+template <typename T, int N>
+constexpr fixed_poly<T, N> fixed_poly<T, N>::operator*(T scalar) const {
+	fixed_poly new_poly;
+	for (int i = 0; i < N; ++i)
+		new_poly._coeff[i] = _coeff[i] * scalar;
+
+	return new_poly;
+}
+
+template <typename T, int N>
+constexpr fixed_poly<T, N> fixed_poly<T, N>::operator-() const {
+	return *this * T(-1);
+}
+
+template <typename T, int N>
+template <int I>
+constexpr T fixed_poly<T, N>::horner(T x, std::integral_constant<int, I>) const {
+	return _coeff[I] + x * horner(x, std::integral_constant<int, I+1>());
+}
+
+template <typename T, int N>
+constexpr T fixed_poly<T, N>::horner(T, std::integral_constant<int, N-1>) const {
+	return _coeff[N-1];
+}
+
+template <typename T, int N>
+template <int K>
+constexpr T fixed_poly<T, N>::power(T x, std::integral_constant<int, K>) {
+	return K % 2
+		? x * power(x, std::integral_constant<int, K-1>())
+		: power(x, std::integral_constant<int, K/2>())
+		  * power(x, std::integral_constant<int, K/2>());
+}
+
+template <typename T, int N>
+constexpr T fixed_poly<T, N>::power(T x, std::integral_constant<int, 1>) {
+	return x;
+}
+
+template <typename T, int N>
+template <int B, int E>
+constexpr T fixed_poly<T, N>::estrin(T, std::true_type) const {
+	return _coeff[B];
+}
+
+template <typename T, int N>
+template <int B, int E>
+constexpr T fixed_poly<T, N>::estrin(T x, std::false_type) const {
+	return estrin<B, (B+E)/2>(x, std::integral_constant<bool, (B+E)/2 - B == 1>())
+		+ power(x, std::integral_constant<int, (B+E)/2 - B>())
+		* estrin<(B+E)/2, E>(x, std::integral_constant<bool, E - (B+E)/2 == 1>());
+}
+
+template <typename T, int N>
+constexpr T fixed_poly<T, N>::operator()(T x) const {
+	return horner(x, std::integral_constant<int, 0>());
+}
+
+template <typename T, int N>
+constexpr T fixed_poly<T, N>::estrin(T x) const {
+	return estrin<0, N>(x, std::integral_constant<bool, N == 1>());
+}
+
+template <typename T, int N>
+template <typename P>
+P fixed_poly<T, N>::to() const {
+	P new_poly;
+	for (int i = 0; i < N; ++i)
+		new_poly.insert(static_cast<int>(_coeff[i]), i);
+
+	return new_poly;
+}
+
+template <typename T, int N>
+template <typename P>
+fixed_poly<T, N> fixed_poly<T, N>::from(const P& argp) {
+	fixed_poly new_poly;
+	for (const auto& t: argp.terms()) {
+		if (t.first < 0 || t.first >= N)
+			throw std::length_error
+			(
+				"exponent " + std::to_string(t.first) + " out of range"
+			);
+
+		new_poly._coeff[t.first] = static_cast<T>(t.second);
+	}
+
+	return new_poly;
+}
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef MPOLY
+#define MPOLY
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include "poly_kernels.h"
+
+class mpoly {
+private:
+	typedef std::uint64_t monomial;
+	typedef std::pair<monomial, int> term;
+
+	int _vars, _bits;
+	monomial _guard;
+	std::vector<term> _terms;
+
+	monomial pack(const int*) const;
+	int unpack(monomial, int) const;
+	monomial add(monomial, monomial) const;
+	void check(const mpoly&) const;
+	mpoly merge(const mpoly&, int) const;
+
+	template <typename Source>
+	void load(Source&);
+
+	void insert(std::istream&);
+	void stream(std::ostream&) const;
+
+public:
+	explicit mpoly(int=1);
+	mpoly(int, const std::string&);
+	mpoly(const mpoly&) = default;
+	mpoly(mpoly&&) = default;
+
+	int vars() const;
+	int max_exp() const;
+	void insert(int, const std::vector<int>&);
+
+	mpoly operator+(const mpoly&) const;
+	mpoly& operator+=(const mpoly&);
+
+	mpoly operator-(const mpoly&) const;
+	mpoly& operator-=(const mpoly&);
+
+	mpoly operator*(const mpoly&) const;
+	mpoly& operator*=(const mpoly&);
+
+	mpoly operator-() const;
+
+	template <typename T>
+	T evaluate(const std::vector<T>&) const;
+
+	mpoly& operator=(const mpoly&) = default;
+	mpoly& operator=(mpoly&&) = default;
+
+	friend std::ostream& operator<<(std::ostream&, const mpoly&);
+	friend std::istream& operator>>(std::istream&, mpoly&);
+};
+
+mpoly::mpoly(int vars) :
+_vars(vars), _bits(vars > 0 ? 64 / vars : 0), _guard(0)
+{
+	if (vars <= 0 || vars > 32)
+		throw std::length_error
+		(
+			"invalid variable count: " + std::to_string(vars)
+		);
+
+	for (int v = 0; v < _vars; ++v)
+		_guard |= monomial(1) << (v*_bits + _bits-1);
+}
+
+mpoly::mpoly(int vars, const std::string& args) :
+mpoly(vars)
+{
+	poly_kernels::char_source src(args.data(), args.data() + args.size());
+	load(src);
+}
+
+template <typename Source>
+void mpoly::load(Source& src) {
+	mpoly new_poly(_vars);
+	std::vector<int> exps(_vars);
+	int co;
+
+	while (poly_kernels::scan_int(src, co)) {
+		int v = 0;
+		while (v < _vars && poly_kernels::scan_int(src, exps[v]))
+			++v;
+
+		if (v < _vars) break;
+		if (co != 0) new_poly._terms.emplace_back(pack(exps.data()), co);
+	}
+
+	src.done();
+	std::sort(new_poly._terms.begin(), new_poly._terms.end(), [](const term& x, const term& y) {
+		return x.first > y.first;
+	});
+
+	std::vector<term> combined;
+	for (auto iter = new_poly._terms.cbegin(); iter != new_poly._terms.cend(); ) {
+		monomial m = iter->first;
+		long long sum = 0;
+
+		for (; iter != new_poly._terms.cend() && iter->first == m; ++iter)
+			sum += iter->second;
+		if (static_cast<int>(sum) != 0)
+			combined.emplace_back(m, static_cast<int>(sum));
+	}
+
+	new_poly._terms = std::move(combined);
+	*this = _terms.empty() ? std::move(new_poly) : *this + new_poly;
+}
+
+inline int mpoly::vars() const {
+	return _vars;
+}
+
+inline int mpoly::max_exp() const {
+	return _bits >= 32 ? 0x7fffffff : (1 << (_bits-1)) - 1;
+}
+
+mpoly::monomial mpoly::pack(const int* exps) const {
+	monomial m = 0;
+
+	for (int v = 0; v < _vars; ++v) {
+		if (exps[v] < 0 || exps[v] > max_exp())
+			throw std::out_of_range
+			(
+				"exponent " + std::to_string(exps[v]) + " out of range"
+			);
+
+		m |= monomial(exps[v]) << ((_vars-1 - v) * _bits);
+	}
+
+	return m;
+}
+
+inline int mpoly::unpack(monomial m, int v) const {
+	monomial mask = _bits == 64 ? ~monomial(0) : (monomial(1) << _bits) - 1;
+	return static_cast<int>((m >> ((_vars-1 - v) * _bits)) & mask);
+}
+
+inline mpoly::monomial mpoly::add(monomial lhs, monomial rhs) const {
+	monomial m = lhs + rhs;
+	if (m & _guard)
+		throw std::overflow_error
+		(
+			"monomial exponent overflow"
+		);
+
+	return m;
+}
+
+void mpoly::check(const mpoly& argp) const {
+	if (_vars != argp._vars)
+		throw std::length_error
+		(
+			"variable count mismatch"
+		);
+}
+
+void mpoly::insert(int coeff, const std::vector<int>& exps) {
+	if (static_cast<int>(exps.size()) != _vars)
+		throw std::length_error
+		(
+			"variable count mismatch"
+		);
+
+	if (coeff == 0) return;
+	monomial m = pack(exps.data());
+
+	auto iter = std::lower_bound(_terms.begin(), _terms.end(), m,
+		[](const term& t, monomial key) { return t.first > key; });
+
+	if (iter == _terms.end() || iter->first != m)
+		_terms.emplace(iter, m, coeff);
+	else if ((iter->second += coeff) == 0)
+		_terms.erase(iter);
+}
+
+mpoly mpoly::merge(const mpoly& argp, int sign) const {
+	check(argp);
+	mpoly new_poly(_vars);
+	new_poly._terms.reserve(_terms.size() + argp._terms.size());
+
+	auto l = _terms.cbegin(), r = argp._terms.cbegin();
+	while (l != _terms.cend() || r != argp._terms.cend()) {
+		if (r == argp._terms.cend() || (l != _terms.cend() && l->first > r->first))
+			new_poly._terms.push_back(*l++);
+		else if (l == _terms.cend() || r->first > l->first) {
+			new_poly._terms.emplace_back(r->first, sign * r->second);
+			++r;
+		} else {
+			int co = l->second + sign * r->second;
+			if (co != 0) new_poly._terms.emplace_back(l->first, co);
+			++l, ++r;
+		}
+	}
+
+	return new_poly;
+}
+
+mpoly mpoly::operator+(const mpoly& argp) const {
+	return merge(argp, 1);
+}
+
+mpoly& mpoly::operator+=(const mpoly& argp) {
+	return *this = *this + argp;
+}
+
+mpoly mpoly::operator-(const mpoly& argp) const {
+	return merge(argp, -1);
+}
+
+mpoly& mpoly::operator-=(const mpoly& argp) {
+	return *this = *this - argp;
+}
+
+mpoly mpoly::operator*(const mpoly& argp) const {
+	check(argp);
+	mpoly new_poly(_vars);
+	if (_terms.empty() || argp._terms.empty())
+		return new_poly;
+
+	const std::vector<term>& a = _terms.size() <= argp._terms.size() ? _terms : argp._terms;
+	const std::vector<term>& b = _terms.size() <= argp._terms.size() ? argp._terms : _terms;
+
+	struct cursor {
+		monomial m;
+		std::size_t i, j;
+		bool operator<(const cursor& c) const { return m < c.m; }
+	};
+
+	std::vector<cursor> heap;
+	heap.reserve(a.size());
+	for (std::size_t i = 0; i < a.size(); ++i)
+		heap.push_back(cursor{add(a[i].first, b[0].first), i, 0});
+	std::make_heap(heap.begin(), heap.end());
+
+	while (!heap.empty()) {
+		monomial m = heap.front().m;
+		long long sum = 0;
+
+		while (!heap.empty() && heap.front().m == m) {
+			std::pop_heap(heap.begin(), heap.end());
+			cursor& c = heap.back();
+			sum += static_cast<long long>(a[c.i].second) * b[c.j].second;
+
+			if (++c.j < b.size()) {
+				c.m = add(a[c.i].first, b[c.j].first);
+				std::push_heap(heap.begin(), heap.end());
+			} else
+				heap.pop_back();
+		}
+
+		if (static_cast<int>(sum) != 0)
+			new_poly._terms.emplace_back(m, static_cast<int>(sum));
+	}
+
+	return new_poly;
+}
+
+mpoly& mpoly::operator*=(const mpoly& argp) {
+	return *this = *this * argp;
+}
+
+mpoly mpoly::operator-() const {
+	return mpoly(_vars) - *this;
+}
+
+template <typename T>
+T mpoly::evaluate(const std::vector<T>& x) const {
+	if (static_cast<int>(x.size()) != _vars)
+		throw std::length_error
+		(
+			"variable count mismatch"
+		);
+
+	T sum = T();
+	for (const term& t: _terms) {
+		T value = T(t.second);
+
+		for (int v = 0; v < _vars; ++v) {
+			T base = x[v];
+			for (int e = unpack(t.first, v); e; e >>= 1) {
+				if (e & 1) value *= base;
+				if (e > 1) base *= base;
+			}
+		}
+
+		sum += value;
+	}
+
+	return sum;
+}
+
+void mpoly::insert(std::istream& stream) {
+	poly_kernels::stream_source src(stream);
+	load(src);
+}
+
+void mpoly::stream(std::ostream& out) const {
+	poly_kernels::term_writer writer(out);
+
+	if (_terms.empty()) {
+		for (int v = 0; v <= _vars; ++v)
+			writer.put(0);
+	}
+
+	for (const term& t: _terms) {
+		writer.put(t.second);
+		for (int v = 0; v < _vars; ++v)
+			writer.put(unpack(t.first, v));
+	}
+
+	writer.flush();
+}
+
+std::ostream& operator<<(std::ostream& out, const mpoly& argp) {
+	argp.stream(out);
+	return out;
+}
+
+std::istream& operator>>(std::istream& in, mpoly& argp) {
+	argp.insert(in);
+	return in;
+}
+
+#endif
@@ -3,7 +3,14 @@
 
 #include <iostream>
 #include <string>
-#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+#include <vector>
+#include <new>
+#include <cstddef>
+#include "poly_kernels.h"
 
 class poly {
 private:
@@ -12,15 +19,52 @@ private:
 		term *_next;
 		
 		term(int=0, int=0);
-		term(const term*);
+	};
+	
+	class term_pool {
+	private:
+		std::vector<term*> _blocks;
+		term *_free, *_cur, *_end;
+		std::size_t _grow;
+		
+		term* block(std::size_t);
+		
+	public:
+		term_pool();
+		term_pool(const term_pool&) = delete;
+		term_pool(term_pool&&);
+		
+		term* make(int=0, int=0);
+		term* make_list(std::size_t);
+		void recycle(term*);
+		void swap(term_pool&);
+		void clear();
+		
+		term_pool& operator=(const term_pool&) = delete;
 		
-		~term();
-	} *_dummy;
+		~term_pool();
+	} _pool;
 	
-	term* new_list() const;
+	term *_dummy;
+	
+	poly(const poly_kernels::terms&);
+	
+	term* new_list(term_pool&) const;
 	void insert(std::istream&);
 	void stream(std::ostream&) const;
 	
+	void sub_mul(const poly&, int, int);
+	void scale(int);
+	void divide_exact(int);
+	int content() const;
+	int low() const;
+	void long_div(const poly&, poly&, poly&) const;
+	void newton_div(const poly&, poly&, poly&) const;
+	poly prem(const poly&) const;
+	
+	static int int_gcd(int, int);
+	static const int newton_cutoff = 32;
+	
 public:
 	poly();
 	poly(const poly&);
@@ -29,6 +73,11 @@ public:
 	
 	void insert(int, int);
 	
+	bool zero() const;
+	int degree() const;
+	int lead() const;
+	poly_kernels::terms terms() const;
+	
 	poly operator+(const poly&) const;
 	poly& operator+=(const poly&);
 	
@@ -38,11 +87,21 @@ public:
 	poly operator*(const poly&) const;
 	poly& operator*=(const poly&);
 	
+	void divmod(const poly&, poly&, poly&) const;
+	
+	poly operator/(const poly&) const;
+	poly& operator/=(const poly&);
+	
+	poly operator%(const poly&) const;
+	poly& operator%=(const poly&);
+	
+	poly pow(unsigned) const;
+	poly pow(unsigned, const poly&) const;
+	
 	poly& operator=(const poly&);
 	poly& operator=(poly&&);
-	
-	~poly();
 
+	friend poly gcd(const poly&, const poly&);
 	friend std::ostream& operator<<(std::ostream&, const poly&);
 	friend std::istream& operator>>(std::istream&, poly&);
 };
@@ -51,51 +110,136 @@ poly::term::term(int co, int e) :
 _coeff(co), _exp(e), _next(nullptr)
 { }
 
-poly::term::term(const term* argt) :
-term(argt->_coeff, argt->_exp)
+poly::term_pool::term_pool() :
+_free(nullptr), _cur(nullptr), _end(nullptr), _grow(16)
 { }
 
-poly::term::~term() {
-	delete _next;
+poly::term_pool::term_pool(term_pool&& argp) :
+_blocks( std::move(argp._blocks) ), _free(argp._free), 
+_cur(argp._cur), _end(argp._end), _grow(argp._grow)
+{
+	argp._blocks.clear();
+	argp._free = argp._cur = argp._end = nullptr;
+	argp._grow = 16;
+}
+
+poly::term* poly::term_pool::block(std::size_t n) {
+	_blocks.reserve(_blocks.size() + 1);
+	term *new_block = static_cast<term*>( ::operator new(n * sizeof(term)) );
+	_blocks.push_back(new_block);
+	
+	return new_block;
+}
+
+poly::term* poly::term_pool::make(int co, int e) {
+	term *ptr = _free;
+	
+	if (ptr)
+		_free = ptr->_next;
+	else {
+		if (_cur == _end) {
+			_cur = block(_grow);
+			_end = _cur + _grow;
+			if (_grow < 4096) _grow *= 2;
+		}
+		ptr = _cur++;
+	}
+	
+	return new (ptr) term(co, e);
+}
+
+poly::term* poly::term_pool::make_list(std::size_t n) {
+	term *list;
+	
+	if (static_cast<std::size_t>(_end - _cur) >= n) {
+		list = _cur;
+		_cur += n;
+	} else 
+		list = block(n);
+	
+	for (std::size_t i = 0; i < n; ++i)
+		new (list + i) term;
+	for (std::size_t i = 1; i < n; ++i)
+		list[i-1]._next = list + i;
+	
+	return list;
+}
+
+void poly::term_pool::recycle(term* argt) {
+	argt->_next = _free;
+	_free = argt;
+}
+
+void poly::term_pool::swap(term_pool& argp) {
+	std::swap(_blocks, argp._blocks);
+	std::swap(_free, argp._free);
+	std::swap(_cur, argp._cur);
+	std::swap(_end, argp._end);
+	std::swap(_grow, argp._grow);
+}
+
+void poly::term_pool::clear() {
+	for (term *ptr: _blocks)
+		::operator delete(ptr);
+	
+	_blocks.clear();
+	_free = _cur = _end = nullptr;
+	_grow = 16;
+}
+
+poly::term_pool::~term_pool() {
+	clear();
 }
 
 poly::poly() :
-_dummy(new term)
+_dummy( _pool.make() )
 { }
 
-poly::term* poly::new_list() const {
-	term *ptr = _dummy, new_ptr = new term;
-	term *r_ptr = new_ptr;
+poly::term* poly::new_list(term_pool& pool) const {
+	std::size_t n = 1;
+	for (term *ptr = _dummy->_next; ptr; ptr = ptr->_next)
+		++n;
 	
-	while (ptr = ptr->_next) {
-		new_ptr->_next = new term(ptr);
-		new_ptr = new_ptr->_next;
+	term *r_ptr = pool.make_list(n), *new_ptr = r_ptr->_next;
+	for (term *ptr = _dummy->_next; ptr; ptr = ptr->_next, new_ptr = new_ptr->_next) {
+		new_ptr->_coeff = ptr->_coeff;
+		new_ptr->_exp = ptr->_exp;
 	}
 	
 	return r_ptr;
 }
 
 poly::poly(poly&& argp) :
-_dummy(argp._dummy)
+_pool( std::move(argp._pool) ), _dummy(argp._dummy)
 {
 	argp._dummy = nullptr;
 }
 
 poly::poly(const poly& argp) :
-_dummy( argp.new_list() )
+_dummy( argp.new_list(_pool) )
 { }
 
+poly::poly(const poly_kernels::terms& argt) :
+_dummy( _pool.make_list(argt.size() + 1) )
+{
+	term *ptr = _dummy;
+	for (auto iter = argt.crbegin(); iter != argt.crend(); ++iter) {
+		ptr = ptr->_next;
+		ptr->_coeff = iter->second;
+		ptr->_exp = iter->first;
+	}
+}
+
 poly::poly(const std::string& args) :
 poly()
 {
-	std::istringstream stream(args);
-	insert(stream);
+	poly_kernels::char_source src(args.data(), args.data() + args.size());
+	*this = poly( poly_kernels::parse(src) );
 }
 
 void poly::insert(std::istream& stream) {
-	int co, exp;
-	while (stream >> co >> exp)
-		insert(co, exp);
+	poly_kernels::stream_source src(stream);
+	*this = poly( poly_kernels::merge_sum(terms(), poly_kernels::parse(src)) );
 }
 
 void poly::insert(int coeff, int exp) {
@@ -108,16 +252,14 @@ void poly::insert(int coeff, int exp) {
 	}
 	
 	if (!rhs)
-		lhs->_next = new term(coeff, exp);
+		lhs->_next = _pool.make(coeff, exp);
 	else if (rhs->_exp == exp) {
 		if ((rhs->_coeff += coeff) == 0) {
-			term *del_term = rhs;
-			lhs->_next = del_term->_next;
-			del_term->_next = nullptr;
-			delete del_term;
+			lhs->_next = rhs->_next;
+			_pool.recycle(rhs);
 		}
 	} else {
-		term *new_term = lhs->_next = new term(coeff, exp);
+		term *new_term = lhs->_next = _pool.make(coeff, exp);
 		new_term->_next = rhs;
 	}
 }
@@ -151,30 +293,248 @@ poly& poly::operator-=(const poly& argp) {
 }
 
 poly poly::operator*(const poly& argp) const {
-	poly new_poly;
-	term *first = _dummy;
+	return poly( poly_kernels::multiply(terms(), argp.terms()) );
+}
+
+poly& poly::operator*=(const poly& argp) {
+	return *this = *this * argp;
+}
+
+bool poly::zero() const {
+	return _dummy->_next == nullptr;
+}
+
+int poly::degree() const {
+	return zero() ? -1 : _dummy->_next->_exp;
+}
+
+int poly::lead() const {
+	return zero() ? 0 : _dummy->_next->_coeff;
+}
+
+poly_kernels::terms poly::terms() const {
+	poly_kernels::terms argt;
+	term *ptr = _dummy;
+	
+	while (ptr = ptr->_next)
+		argt.emplace_back(ptr->_exp, ptr->_coeff);
+	
+	std::reverse(argt.begin(), argt.end());
+	return argt;
+}
+
+int poly::low() const {
+	term *ptr = _dummy->_next;
+	if (!ptr) return 0;
+	
+	while (ptr->_next)
+		ptr = ptr->_next;
+	
+	return ptr->_exp;
+}
+
+int poly::int_gcd(int a, int b) {
+	a = std::abs(a);
+	b = std::abs(b);
+	
+	while (b) {
+		int r = a % b;
+		a = b;
+		b = r;
+	}
 	
-	while (first = first->_next) {
-		term *second = argp._dummy;
-		int co1 = first->_coeff, e1 = first->_exp;
+	return a;
+}
+
+int poly::content() const {
+	int g = 0;
+	term *ptr = _dummy;
+	
+	while ((ptr = ptr->_next) && g != 1)
+		g = int_gcd(g, ptr->_coeff);
+	
+	return g;
+}
+
+void poly::scale(int factor) {
+	if (factor == 0) {
+		_pool.clear();
+		_dummy = _pool.make();
+		return;
+	}
+	
+	term *ptr = _dummy;
+	while (ptr = ptr->_next)
+		ptr->_coeff = poly_kernels::narrow(static_cast<long long>(ptr->_coeff) * factor);
+}
+
+void poly::divide_exact(int divisor) {
+	term *ptr = _dummy;
+	while (ptr = ptr->_next)
+		ptr->_coeff /= divisor;
+}
+
+void poly::sub_mul(const poly& argp, int coeff, int exp) {
+	term *lhs = _dummy, *rhs = lhs->_next, *ptr = argp._dummy;
+	
+	while (ptr = ptr->_next) {
+		long long co = -static_cast<long long>(coeff) * ptr->_coeff;
+		int e = ptr->_exp + exp;
+		
+		while (rhs && rhs->_exp > e) {
+			lhs = rhs;
+			rhs = rhs->_next;
+		}
 		
-		while (second = second->_next) {
-			int co2 = second->_coeff, e2 = second->_exp;
-			new_poly.insert(co1*co2, e1+e2);
+		if (rhs && rhs->_exp == e) {
+			if ((rhs->_coeff = poly_kernels::narrow(rhs->_coeff + co)) == 0) {
+				lhs->_next = rhs->_next;
+				_pool.recycle(rhs);
+				rhs = lhs->_next;
+			}
+		} else {
+			term *new_term = lhs->_next = _pool.make(poly_kernels::narrow(co), e);
+			new_term->_next = rhs;
+			lhs = new_term;
 		}
 	}
+}
+
+void poly::long_div(const poly& argp, poly& quot, poly& rem) const {
+	int d = argp.degree(), lc = argp.lead();
+	poly q, r(*this);
+	term *q_tail = q._dummy;
 	
-	return new_poly;
+	while (!r.zero() && r.degree() >= d) {
+		int rc = r.lead(), e = r.degree() - d;
+		if (rc % lc != 0)
+			throw std::domain_error
+			(
+				"inexact division: " + std::to_string(rc) 
+				+ " not divisible by " + std::to_string(lc)
+			);
+		
+		q_tail = q_tail->_next = q._pool.make(rc / lc, e);
+		r.sub_mul(argp, rc / lc, e);
+	}
+	
+	quot = std::move(q);
+	rem = std::move(r);
 }
 
-poly& poly::operator*=(const poly& argp) {
-	return *this = *this * argp;
+void poly::newton_div(const poly& argp, poly& quot, poly& rem) const {
+	poly_kernels::terms q, r;
+	poly_kernels::newton_divide(terms(), argp.terms(), q, r);
+	
+	quot = poly(q);
+	rem = poly(r);
+}
+
+void poly::divmod(const poly& argp, poly& quot, poly& rem) const {
+	if (argp.zero())
+		throw std::domain_error
+		(
+			"division by zero polynomial"
+		);
+	
+	int n = degree(), m = argp.degree(), lc = argp.lead();
+	
+	if ((lc == 1 || lc == -1) && n-m+1 >= newton_cutoff 
+		&& low() >= 0 && argp.low() >= 0)
+		newton_div(argp, quot, rem);
+	else
+		long_div(argp, quot, rem);
+}
+
+poly poly::operator/(const poly& argp) const {
+	poly quot, rem;
+	divmod(argp, quot, rem);
+	return quot;
+}
+
+poly& poly::operator/=(const poly& argp) {
+	return *this = *this / argp;
+}
+
+poly poly::operator%(const poly& argp) const {
+	poly quot, rem;
+	divmod(argp, quot, rem);
+	return rem;
+}
+
+poly& poly::operator%=(const poly& argp) {
+	return *this = *this % argp;
+}
+
+poly poly::pow(unsigned e) const {
+	poly result, base(*this);
+	result.insert(1, 0);
+	
+	while (e) {
+		if (e & 1) result *= base;
+		if (e >>= 1) base *= base;
+	}
+	
+	return result;
+}
+
+poly poly::pow(unsigned e, const poly& mod) const {
+	poly result, base(*this % mod);
+	result.insert(1, 0);
+	result %= mod;
+	
+	while (e) {
+		if (e & 1) result = result * base % mod;
+		if (e >>= 1) base = base * base % mod;
+	}
+	
+	return result;
+}
+
+// the pseudo-remainder up to a constant factor: the content is taken out after
+// every step, or the coefficients grow exponentially with the degree
+poly poly::prem(const poly& argp) const {
+	int d = argp.degree(), lc = argp.lead();
+	poly r(*this);
+	
+	while (!r.zero() && r.degree() >= d) {
+		int rc = r.lead(), g = int_gcd(rc, lc);
+		r.scale(lc / g);
+		r.sub_mul(argp, rc / g, r.degree() - d);
+		if (!r.zero()) r.divide_exact(r.content());
+	}
+	
+	return r;
+}
+
+poly gcd(const poly& argp1, const poly& argp2) {
+	if (argp1.zero() && argp2.zero())
+		return poly();
+	
+	int c = poly::int_gcd(argp1.content(), argp2.content());
+	poly a(argp1), b(argp2);
+	
+	if (a.degree() < b.degree())
+		std::swap(a, b);
+	if (!a.zero()) a.divide_exact(a.content());
+	if (!b.zero()) b.divide_exact(b.content());
+	
+	while (!b.zero()) {
+		poly r = a.prem(b);
+		a = std::move(b);
+		b = std::move(r);
+	}
+	
+	a.scale(a.lead() < 0 ? -c : c);
+	return a;
 }
 
 poly& poly::operator=(const poly& argp) {
 	if (this != &argp) {
-		delete _dummy;
-		_dummy = argp.new_list();
+		term_pool pool;
+		term *new_dummy = argp.new_list(pool);
+		_pool.swap(pool);
+		_dummy = new_dummy;
 	}
 	
 	return *this;
@@ -182,29 +542,21 @@ poly& poly::operator=(const poly& argp) {
 
 poly& poly::operator=(poly&& argp) {
 	if (this != &argp) {
-		term *temp = _dummy;
-		_dummy = argp._dummy;
-		argp._dummy = temp;
+		std::swap(_dummy, argp._dummy);
+		_pool.swap(argp._pool);
 	}
 	
 	return *this;
 }
 
-poly::~poly() {
-	delete _dummy;
-}
-
 void poly::stream(std::ostream& out) const {
-	term *term_ptr = _dummy->_next;
+	poly_kernels::term_writer writer(out);
+	term *ptr = _dummy;
 	
-	if (!term_ptr)
-		out << "0 0";
-	else {
-		while (term_ptr) {
-			out << term_ptr->_coeff << ' ' << term_ptr->_exp;
-			if (term_ptr = term_ptr->_next) out << ' ';
-		}
-	}
+	while (ptr = ptr->_next)
+		writer.put(ptr->_coeff, ptr->_exp);
+	
+	writer.flush();
 }
 
 std::ostream& operator<<(std::ostream& out, const poly& argp) {
@@ -0,0 +1,290 @@
+// g++ -std=c++14 -O2 -pthread poly_bench.cpp -o poly_bench
+// ./poly_bench [reps] > results.csv
+//
+// poly.h and poly_stl.h both define ::poly, so each is wrapped in its own
+// namespace; every standard header they use is included up front so their
+// include guards keep the std declarations out of those namespaces.
+//
+// every result is checked against a naive reference that shares no code with
+// poly_kernels: terms read with operator>>, sums and schoolbook products
+// accumulated in long long, and output written with operator<<.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include "poly_kernels.h"
+
+namespace linked {
+#include "poly.h"
+}
+
+namespace stl {
+#include "poly_stl.h"
+}
+
+namespace {
+
+std::atomic<std::size_t> alloc_count(0), live_bytes(0), peak_bytes(0);
+
+void note_alloc(std::size_t n) {
+	++alloc_count;
+	std::size_t live = live_bytes += n, peak = peak_bytes;
+	while (live > peak && !peak_bytes.compare_exchange_weak(peak, live))
+		;
+}
+
+const std::size_t header = alignof(std::max_align_t);
+
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t n) {
+	char *ptr = static_cast<char*>( std::malloc(n + header) );
+	if (!ptr) throw std::bad_alloc();
+
+	*reinterpret_cast<std::size_t*>(ptr) = n;
+	note_alloc(n);
+	return ptr + header;
+}
+
+void operator delete(void* ptr) noexcept {
+	if (!ptr) return;
+
+	char *base = static_cast<char*>(ptr) - header;
+	live_bytes -= *reinterpret_cast<std::size_t*>(base);
+	std::free(base);
+}
+
+void* operator new[](std::size_t n) { return operator new(n); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { operator delete(ptr); }
+
+namespace {
+
+struct sample {
+	double ns;
+	std::size_t allocs, peak;
+	std::string result;
+};
+
+std::string random_text(int degree, double density, std::mt19937& gen) {
+	std::uniform_real_distribution<double> pick(0.0, 1.0);
+	std::uniform_int_distribution<int> coeff(-100, 99);
+	std::ostringstream out;
+
+	for (int e = degree; e >= 0; --e) {
+		if (e != degree && pick(gen) >= density) continue;
+
+		int co = coeff(gen);
+		out << (co >= 0 ? co + 1 : co) << ' ' << e << ' ';
+	}
+
+	return out.str();
+}
+
+std::string print(const poly_kernels::terms& t) {
+	std::ostringstream out;
+	poly_kernels::term_writer writer(out);
+	for (auto iter = t.crbegin(); iter != t.crend(); ++iter)
+		writer.put(iter->second, iter->first);
+
+	writer.flush();
+	return out.str();
+}
+
+template <typename P>
+std::string print(const P& p) {
+	std::ostringstream out;
+	out << p;
+	return out.str();
+}
+
+poly_kernels::terms parse(const std::string& text) {
+	poly_kernels::char_source src(text.data(), text.data() + text.size());
+	return poly_kernels::parse(src);
+}
+
+std::string print(const std::string& text) {
+	return text;
+}
+
+typedef std::map<int, long long> naive_poly;
+
+naive_poly naive_parse(const std::string& text) {
+	std::istringstream in(text);
+	naive_poly p;
+	long long co;
+	int exp;
+
+	while (in >> co >> exp)
+		if ((p[exp] += co) == 0) p.erase(exp);
+
+	return p;
+}
+
+naive_poly naive_add(const naive_poly& a, const naive_poly& b) {
+	naive_poly sum(a);
+	for (const auto& t: b)
+		if ((sum[t.first] += t.second) == 0) sum.erase(t.first);
+
+	return sum;
+}
+
+naive_poly naive_multiply(const naive_poly& a, const naive_poly& b) {
+	if (a.empty() || b.empty())
+		return naive_poly();
+
+	std::vector<std::pair<int, long long>> ta(a.cbegin(), a.cend()), tb(b.cbegin(), b.cend());
+	long long lo = static_cast<long long>(ta.front().first) + tb.front().first;
+	long long hi = static_cast<long long>(ta.back().first) + tb.back().first;
+	std::vector<long long> prod(hi - lo + 1);
+
+	for (const auto& x: ta)
+		for (const auto& y: tb)
+			prod[x.first + y.first - lo] += x.second * y.second;
+
+	naive_poly p;
+	for (std::size_t k = 0; k < prod.size(); ++k)
+		if (prod[k] != 0) p.emplace_hint(p.end(), static_cast<int>(lo + k), prod[k]);
+
+	return p;
+}
+
+std::string naive_print(const naive_poly& p) {
+	if (p.empty())
+		return "0 0";
+
+	std::ostringstream out;
+	for (auto iter = p.crbegin(); iter != p.crend(); ++iter) {
+		if (iter != p.crbegin()) out << ' ';
+		out << iter->second << ' ' << iter->first;
+	}
+
+	return out.str();
+}
+
+template <typename F>
+sample measure(int reps, F op) {
+	sample best = { 1e300, 0, 0, std::string() };
+
+	for (int r = 0; r < reps; ++r) {
+		std::size_t allocs0 = alloc_count, live0 = live_bytes;
+		peak_bytes = live0;
+
+		auto start = std::chrono::steady_clock::now();
+		auto value = op();
+		auto stop = std::chrono::steady_clock::now();
+
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+		if (ns < best.ns) {
+			best.ns = ns;
+			best.allocs = alloc_count - allocs0;
+			best.peak = peak_bytes - live0;
+		}
+		best.result = print(value);
+	}
+
+	return best;
+}
+
+struct row {
+	std::string op;
+	sample impl[3];
+};
+
+template <typename P>
+void run_poly(const std::string& ta, const std::string& tb, int reps, std::vector<row>& rows, int slot) {
+	P a(ta), b(tb);
+	const char *ops[] = { "parse", "add", "multiply", "copy", "print" };
+
+	sample s[] = {
+		measure(reps, [&] { return P(ta); }),
+		measure(reps, [&] { return a + b; }),
+		measure(reps, [&] { return a * b; }),
+		measure(reps, [&] { return P(a); }),
+		measure(reps, [&] { return print(a); })
+	};
+
+	for (int i = 0; i < 5; ++i) {
+		rows[i].op = ops[i];
+		rows[i].impl[slot] = s[i];
+	}
+}
+
+void run_kernels(const std::string& ta, const std::string& tb, int reps, std::vector<row>& rows) {
+	poly_kernels::terms a = parse(ta), b = parse(tb);
+
+	rows[0].impl[2] = measure(reps, [&] { return parse(ta); });
+	rows[1].impl[2] = measure(reps, [&] { return poly_kernels::merge_sum(a, b); });
+	rows[2].impl[2] = measure(reps, [&] { return poly_kernels::multiply(a, b); });
+	rows[3].impl[2] = measure(reps, [&] { return poly_kernels::terms(a); });
+	rows[4].impl[2] = measure(reps, [&] { return print(a); });
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	int reps = argc > 1 ? std::atoi(argv[1]) : 3;
+	if (reps < 1) reps = 1;
+
+	const int degrees[] = { 256, 2048, 16384 };
+	const double densities[] = { 1.0, 0.1, 0.01 };
+	const char *names[] = { "linked", "stl", "kernels" };
+
+	std::mt19937 gen(20261019);
+	bool mismatch = false;
+
+	std::cout << "impl,op,degree,density,terms,ns,allocs,peak_bytes\n";
+
+	for (int degree: degrees) {
+		for (double density: densities) {
+			std::string ta = random_text(degree, density, gen);
+			std::string tb = random_text(degree, density, gen);
+			std::size_t terms = parse(ta).size();
+			std::vector<row> rows(5);
+
+			naive_poly na = naive_parse(ta), nb = naive_parse(tb);
+			const std::string expected[] = {
+				naive_print(na), naive_print( naive_add(na, nb) ), naive_print( naive_multiply(na, nb) ),
+				naive_print(na), naive_print(na)
+			};
+
+			run_poly<linked::poly>(ta, tb, reps, rows, 0);
+			run_poly<stl::poly>(ta, tb, reps, rows, 1);
+			run_kernels(ta, tb, reps, rows);
+
+			for (std::size_t op = 0; op < rows.size(); ++op) {
+				const row& r = rows[op];
+
+				for (int i = 0; i < 3; ++i) {
+					std::cout << names[i] << ',' << r.op << ',' << degree << ','
+						<< density << ',' << terms << ',' << static_cast<long long>(r.impl[i].ns) << ','
+						<< r.impl[i].allocs << ',' << r.impl[i].peak << '\n';
+
+					if (r.impl[i].result != expected[op]) {
+						std::cerr << "mismatch: " << names[i] << ' ' << r.op << " degree " << degree
+							<< " density " << density << '\n';
+						mismatch = true;
+					}
+				}
+			}
+		}
+	}
+
+	return mismatch ? 1 : 0;
+}
@@ -0,0 +1,598 @@
+#ifndef POLY_KERNELS
+#define POLY_KERNELS
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+#include <climits>
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace poly_kernels {
+
+// (exponent, coefficient) pairs in ascending exponent order, no zero coefficients
+typedef std::pair<int, int> term;
+typedef std::vector<term> terms;
+
+const std::size_t parallel_cutoff = 1 << 15;
+const std::size_t dense_factor = 4;
+
+class thread_pool {
+private:
+	std::vector<std::thread> _workers;
+	std::mutex _mtx, _run_mtx;
+	std::condition_variable _cv, _done_cv;
+	std::function<void(int)> _task;
+	std::exception_ptr _error;
+	int _next, _count, _pending;
+	unsigned _gen;
+	bool _stop;
+
+	static bool& in_worker();
+	void work();
+	void drain(std::unique_lock<std::mutex>&);
+
+public:
+	explicit thread_pool(unsigned);
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	unsigned size() const;
+	void run(int, const std::function<void(int)>&);
+
+	~thread_pool();
+};
+
+inline bool& thread_pool::in_worker() {
+	static thread_local bool flag = false;
+	return flag;
+}
+
+inline thread_pool::thread_pool(unsigned threads) :
+_next(0), _count(0), _pending(0), _gen(0), _stop(false)
+{
+	for (unsigned i = 1; i < threads; ++i)
+		_workers.emplace_back(&thread_pool::work, this);
+}
+
+inline unsigned thread_pool::size() const {
+	return _workers.size() + 1;
+}
+
+inline void thread_pool::drain(std::unique_lock<std::mutex>& lock) {
+	while (_next < _count) {
+		int i = _next++;
+		lock.unlock();
+
+		try {
+			_task(i);
+		} catch (...) {
+			lock.lock();
+			if (!_error) _error = std::current_exception();
+			lock.unlock();
+		}
+
+		lock.lock();
+		if (--_pending == 0) _done_cv.notify_all();
+	}
+}
+
+inline void thread_pool::work() {
+	in_worker() = true;
+	unsigned seen = 0;
+	std::unique_lock<std::mutex> lock(_mtx);
+
+	for (;;) {
+		_cv.wait(lock, [&] { return _stop || _gen != seen; });
+		if (_stop) return;
+
+		seen = _gen;
+		drain(lock);
+	}
+}
+
+inline void thread_pool::run(int n, const std::function<void(int)>& task) {
+	if (_workers.empty() || n <= 1 || in_worker()) {
+		for (int i = 0; i < n; ++i)
+			task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> run_lock(_run_mtx);
+	std::unique_lock<std::mutex> lock(_mtx);
+	_task = task;
+	_error = nullptr;
+	_next = 0;
+	_count = _pending = n;
+	++_gen;
+	_cv.notify_all();
+
+	drain(lock);
+	_done_cv.wait(lock, [&] { return _pending == 0; });
+	_task = nullptr;
+
+	if (_error) std::rethrow_exception(_error);
+}
+
+inline thread_pool::~thread_pool() {
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		_stop = true;
+	}
+
+	_cv.notify_all();
+	for (auto& worker: _workers)
+		worker.join();
+}
+
+inline unsigned default_threads() {
+	if (const char *env = std::getenv("POLY_THREADS")) {
+		int n = std::atoi(env);
+		if (n > 0) return n;
+	}
+
+	unsigned n = std::thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+inline thread_pool& pool() {
+	static thread_pool instance( default_threads() );
+	return instance;
+}
+
+// a single chunk runs inline, so small inputs never start the pool
+inline void run_chunks(int n, const std::function<void(int)>& task) {
+	if (n <= 1) {
+		for (int i = 0; i < n; ++i)
+			task(i);
+		return;
+	}
+
+	pool().run(n, task);
+}
+
+// coefficients are stored as int; a result that does not fit is an error, not a wrap
+inline int narrow(long long coeff) {
+	if (coeff < INT_MIN || coeff > INT_MAX)
+		throw std::overflow_error
+		(
+			"coefficient overflow: " + std::to_string(coeff)
+		);
+
+	return static_cast<int>(coeff);
+}
+
+// how the products making up a coefficient are summed. exact_sum is plain long
+// long, for when the caller has bounded the sums; checked_sum tests every
+// addition; wrapped_sum works modulo 2^32, where overflow is harmless
+struct exact_sum {
+	typedef long long type;
+	static type add(type sum, type x) { return sum + x; }
+	static int get(type sum) { return narrow(sum); }
+};
+
+struct checked_sum {
+	typedef long long type;
+
+	static type add(type sum, type x) {
+		if (x > 0 ? sum > LLONG_MAX - x : sum < LLONG_MIN - x)
+			throw std::overflow_error
+			(
+				"coefficient overflow"
+			);
+
+		return sum + x;
+	}
+
+	static int get(type sum) { return narrow(sum); }
+};
+
+struct wrapped_sum {
+	typedef unsigned long long type;
+	static type add(type sum, type x) { return sum + x; }
+	static int get(type sum) { return static_cast<int>(static_cast<unsigned>(sum)); }
+};
+
+template <typename Ring>
+inline void push(terms& out, int exp, typename Ring::type coeff) {
+	int co = Ring::get(coeff);
+	if (co != 0)
+		out.emplace_back(exp, co);
+}
+
+inline void push(terms& out, int exp, long long coeff) {
+	push<exact_sum>(out, exp, coeff);
+}
+
+inline void normalize(terms& t) {
+	std::stable_sort(t.begin(), t.end(), [](const term& x, const term& y) {
+		return x.first < y.first;
+	});
+
+	terms out;
+	out.reserve(t.size());
+
+	for (auto iter = t.cbegin(); iter != t.cend(); ) {
+		int exp = iter->first;
+		long long sum = 0;
+
+		for (; iter != t.cend() && iter->first == exp; ++iter)
+			sum += iter->second;
+		push(out, exp, sum);
+	}
+
+	t = std::move(out);
+}
+
+inline terms merge_sum(const terms& lhs, const terms& rhs) {
+	terms out;
+	out.reserve(lhs.size() + rhs.size());
+	auto l = lhs.cbegin(), r = rhs.cbegin();
+
+	while (l != lhs.cend() && r != rhs.cend()) {
+		if (l->first < r->first)
+			out.push_back(*l++);
+		else if (r->first < l->first)
+			out.push_back(*r++);
+		else {
+			push(out, l->first, static_cast<long long>(l->second) + r->second);
+			++l, ++r;
+		}
+	}
+
+	out.insert(out.end(), l, lhs.cend());
+	out.insert(out.end(), r, rhs.cend());
+	return out;
+}
+
+class char_source {
+private:
+	const char *_ptr, *_end;
+
+public:
+	char_source(const char *begin, const char *end) : _ptr(begin), _end(end) { }
+
+	int peek() const { return _ptr != _end ? static_cast<unsigned char>(*_ptr) : std::char_traits<char>::eof(); }
+	void bump() { ++_ptr; }
+	void done() { }
+};
+
+class stream_source {
+private:
+	std::istream& _in;
+	std::streambuf *_buf;
+
+public:
+	explicit stream_source(std::istream& in) : 
+	_in(in), _buf(std::istream::sentry(in, true) ? in.rdbuf() : nullptr) 
+	{ }
+
+	int peek() const { return _buf ? _buf->sgetc() : std::char_traits<char>::eof(); }
+	void bump() { _buf->sbumpc(); }
+
+	void done() {
+		std::ios_base::iostate state = std::ios_base::failbit;
+		if (peek() == std::char_traits<char>::eof()) state |= std::ios_base::eofbit;
+		_in.setstate(state);
+	}
+};
+
+template <typename Source>
+bool scan_int(Source& src, int& value) {
+	int c = src.peek();
+	while (c == ' ' || (c >= '\t' && c <= '\r')) {
+		src.bump();
+		c = src.peek();
+	}
+
+	bool neg = c == '-';
+	if (c == '-' || c == '+') {
+		src.bump();
+		c = src.peek();
+	}
+
+	if (c < '0' || c > '9')
+		return false;
+
+	long long v = 0;
+	do {
+		v = v*10 + (c - '0');
+		if (v > static_cast<long long>(INT_MAX) + 1) return false;
+		src.bump();
+		c = src.peek();
+	} while (c >= '0' && c <= '9');
+
+	if (!neg && v > INT_MAX)
+		return false;
+
+	value = static_cast<int>(neg ? -v : v);
+	return true;
+}
+
+template <typename Source>
+terms parse(Source& src) {
+	terms out;
+	int co, exp;
+
+	while (scan_int(src, co) && scan_int(src, exp))
+		if (co != 0) out.emplace_back(exp, co);
+
+	src.done();
+	normalize(out);
+	return out;
+}
+
+class term_writer {
+private:
+	std::ostream& _out;
+	char _buf[4096];
+	std::size_t _len;
+	bool _empty;
+
+public:
+	explicit term_writer(std::ostream& out) : _out(out), _len(0), _empty(true) { }
+	term_writer(const term_writer&) = delete;
+	term_writer& operator=(const term_writer&) = delete;
+
+	void put(int);
+	void put(int, int);
+	void flush();
+};
+
+inline void term_writer::put(int value) {
+	if (_len > sizeof(_buf) - 16) {
+		_out.write(_buf, _len);
+		_len = 0;
+	}
+
+	if (!_empty) _buf[_len++] = ' ';
+	_empty = false;
+
+	char digits[12];
+	int n = 0;
+	unsigned long long v = value < 0 ? -static_cast<long long>(value) : value;
+
+	do {
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	if (value < 0) _buf[_len++] = '-';
+	while (n) _buf[_len++] = digits[--n];
+}
+
+inline void term_writer::put(int coeff, int exp) {
+	put(coeff);
+	put(exp);
+}
+
+inline void term_writer::flush() {
+	if (_empty) put(0, 0);
+
+	_out.write(_buf, _len);
+	_len = 0;
+}
+
+template <typename Ring>
+terms mul_heap(const term *a, std::size_t na, const terms& b) {
+	struct cursor {
+		int exp;
+		std::size_t i, j;
+		bool operator<(const cursor& c) const { return exp > c.exp; }
+	};
+
+	std::vector<cursor> heap;
+	heap.reserve(na);
+	for (std::size_t i = 0; i < na; ++i)
+		heap.push_back(cursor{a[i].first + b[0].first, i, 0});
+	std::make_heap(heap.begin(), heap.end());
+
+	terms out;
+	while (!heap.empty()) {
+		int exp = heap.front().exp;
+		typename Ring::type sum = 0;
+
+		while (!heap.empty() && heap.front().exp == exp) {
+			std::pop_heap(heap.begin(), heap.end());
+			cursor& c = heap.back();
+			sum = Ring::add(sum, static_cast<typename Ring::type>(a[c.i].second) * b[c.j].second);
+
+			if (++c.j < b.size()) {
+				c.exp = a[c.i].first + b[c.j].first;
+				std::push_heap(heap.begin(), heap.end());
+			} else
+				heap.pop_back();
+		}
+
+		push<Ring>(out, exp, sum);
+	}
+
+	return out;
+}
+
+inline bool dense(const terms& t) {
+	std::size_t span = static_cast<long long>(t.back().first) - t.front().first + 1;
+	return span <= t.size() * dense_factor;
+}
+
+template <typename Ring>
+terms mul_dense(const terms& a, const terms& b, unsigned chunks) {
+	typedef typename Ring::type sum_type;
+
+	int a_lo = a.front().first, b_lo = b.front().first;
+	std::size_t sa = a.back().first - a_lo + 1, sb = b.back().first - b_lo + 1;
+	std::size_t sc = sa + sb - 1;
+
+	std::vector<sum_type> da(sa), rb(sb), dc(sc);
+	for (const auto& t: a) da[t.first - a_lo] = t.second;
+	for (const auto& t: b) rb[sb-1 - (t.first - b_lo)] = t.second;
+
+	run_chunks(chunks, [&](int c) {
+		std::size_t lo = sc * c / chunks, hi = sc * (c+1) / chunks;
+		for (std::size_t k = lo; k < hi; ++k) {
+			std::size_t i = k >= sb ? k - (sb-1) : 0, end = k < sa ? k : sa-1;
+			const sum_type *pa = da.data() + i, *pb = rb.data() + (sb-1+i) - k;
+			sum_type sum = 0;
+
+			for (std::size_t n = end - i + 1; n; --n)
+				sum = Ring::add(sum, *pa++ * *pb++);
+			dc[k] = sum;
+		}
+	});
+
+	terms out;
+	for (std::size_t k = 0; k < sc; ++k)
+		push<Ring>(out, static_cast<int>(a_lo + b_lo + k), dc[k]);
+
+	return out;
+}
+
+template <typename Ring>
+terms multiply_in(const terms& lhs, const terms& rhs) {
+	if (lhs.empty() || rhs.empty())
+		return terms();
+
+	const terms& a = lhs.size() <= rhs.size() ? lhs : rhs;
+	const terms& b = lhs.size() <= rhs.size() ? rhs : lhs;
+	std::size_t work = a.size() * b.size();
+	unsigned threads = work < parallel_cutoff ? 1 : pool().size();
+
+	if (dense(a) && dense(b))
+		return mul_dense<Ring>(a, b, threads);
+
+	unsigned chunks = threads < a.size() ? threads : a.size();
+	std::vector<terms> partial(chunks);
+
+	run_chunks(chunks, [&](int c) {
+		std::size_t lo = a.size() * c / chunks, hi = a.size() * (c+1) / chunks;
+		partial[c] = mul_heap<Ring>(a.data() + lo, hi - lo, b);
+	});
+
+	while (partial.size() > 1) {
+		std::size_t pairs = partial.size() / 2;
+		std::vector<terms> merged(pairs + partial.size() % 2);
+
+		run_chunks(pairs, [&](int p) {
+			merged[p] = merge_sum(partial[2*p], partial[2*p+1]);
+		});
+
+		if (partial.size() % 2)
+			merged.back() = std::move(partial.back());
+		partial = std::move(merged);
+	}
+
+	return std::move(partial.front());
+}
+
+inline long long max_coeff(const terms& t) {
+	long long m = 0;
+	for (const auto& x: t)
+		m = std::max(m, std::abs(static_cast<long long>(x.second)));
+
+	return m;
+}
+
+// no coefficient sums more than min(|lhs|, |rhs|) products, so when that many
+// of the largest possible product fit, no sum can overflow and none is tested
+inline terms multiply(const terms& lhs, const terms& rhs) {
+	if (lhs.empty() || rhs.empty())
+		return terms();
+
+	long long n = std::min(lhs.size(), rhs.size());
+	if (max_coeff(lhs) * max_coeff(rhs) <= LLONG_MAX / n)
+		return multiply_in<exact_sum>(lhs, rhs);
+
+	return multiply_in<checked_sum>(lhs, rhs);
+}
+
+inline terms merge_diff(const terms& lhs, const terms& rhs) {
+	terms out;
+	out.reserve(lhs.size() + rhs.size());
+	auto l = lhs.cbegin(), r = rhs.cbegin();
+
+	while (l != lhs.cend() || r != rhs.cend()) {
+		if (r == rhs.cend() || (l != lhs.cend() && l->first < r->first))
+			out.push_back(*l++);
+		else if (l == lhs.cend() || r->first < l->first) {
+			push(out, r->first, -static_cast<long long>(r->second));
+			++r;
+		} else {
+			push(out, l->first, static_cast<long long>(l->second) - r->second);
+			++l, ++r;
+		}
+	}
+
+	return out;
+}
+
+// x^n t(1/x), for t of degree at most n
+inline terms reverse(const terms& t, int n) {
+	terms out;
+	out.reserve(t.size());
+	for (auto iter = t.crbegin(); iter != t.crend(); ++iter)
+		out.emplace_back(n - iter->first, iter->second);
+
+	return out;
+}
+
+// the terms below x^n
+inline terms truncate(const terms& t, int n) {
+	auto end = std::lower_bound(t.cbegin(), t.cend(), n, [](const term& x, int e) {
+		return x.first < e;
+	});
+
+	return terms(t.cbegin(), end);
+}
+
+// quotient and remainder of num by den through a Newton inverse of the reversed
+// divisor. den must be monic up to sign and neither may have negative exponents.
+// the series coefficients grow far past int, so the quotient is computed modulo
+// 2^32; a wrapped quotient leaves a remainder of degree deg(den) or more, which
+// is how a quotient too large for int is caught
+inline void newton_divide(const terms& num, const terms& den, terms& quot, terms& rem) {
+	int n = num.back().first, m = den.back().first, len = n - m + 1;
+	terms f = reverse(den, m), g(1, term(0, den.back().second));
+
+	for (int k = 1; k < len; ) {
+		k = k*2 < len ? k*2 : len;
+		terms e = truncate(multiply_in<wrapped_sum>(truncate(f, k), g), k);
+
+		terms two_e;
+		two_e.reserve(e.size() + 1);
+		wrapped_sum::type c0 = 2;
+		std::size_t i = 0;
+
+		if (!e.empty() && e[0].first == 0)
+			c0 -= static_cast<wrapped_sum::type>(e[i++].second);
+		push<wrapped_sum>(two_e, 0, c0);
+		for (; i < e.size(); ++i)
+			push<wrapped_sum>(two_e, e[i].first, 0 - static_cast<wrapped_sum::type>(e[i].second));
+
+		g = truncate(multiply_in<wrapped_sum>(g, two_e), k);
+	}
+
+	terms q = reverse(truncate(multiply_in<wrapped_sum>(truncate(reverse(num, n), len), g), len), n - m);
+	terms r = merge_diff(num, multiply(den, q));
+
+	if (!r.empty() && r.back().first >= m)
+		throw std::overflow_error
+		(
+			"quotient coefficient overflow"
+		);
+
+	quot = std::move(q);
+	rem = std::move(r);
+}
+
+}
+
+#endif
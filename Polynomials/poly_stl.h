@@ -3,16 +3,32 @@
 
 #include <iostream>
 #include <string>
-#include <sstream>
 #include <map>
 #include <utility>
+#include <stdexcept>
+#include <cstdlib>
+#include "poly_kernels.h"
 
 class poly {
 private:
 	std::map<int, int> _poly;
 	
+	poly(const poly_kernels::terms&);
+	
 	void insert(std::istream&);
 	
+	void sub_mul(const poly&, int, int);
+	void scale(int);
+	void divide_exact(int);
+	int content() const;
+	int low() const;
+	void long_div(const poly&, poly&, poly&) const;
+	void newton_div(const poly&, poly&, poly&) const;
+	poly prem(const poly&) const;
+	
+	static int int_gcd(int, int);
+	static const int newton_cutoff = 32;
+	
 public:
 	poly();
 	poly(const std::string&);
@@ -21,6 +37,11 @@ public:
 	
 	void insert(int, int);
 	
+	bool zero() const;
+	int degree() const;
+	int lead() const;
+	poly_kernels::terms terms() const;
+	
 	poly operator+(const poly&) const;
 	poly& operator+=(const poly&);
 	
@@ -30,9 +51,21 @@ public:
 	poly operator*(const poly&) const;
 	poly& operator*=(const poly&);
 	
+	void divmod(const poly&, poly&, poly&) const;
+	
+	poly operator/(const poly&) const;
+	poly& operator/=(const poly&);
+	
+	poly operator%(const poly&) const;
+	poly& operator%=(const poly&);
+	
+	poly pow(unsigned) const;
+	poly pow(unsigned, const poly&) const;
+	
 	poly operator-() const;
 	poly& operator=(poly&&);
 
+	friend poly gcd(const poly&, const poly&);
 	friend std::ostream& operator<<(std::ostream&, const poly&);
 	friend std::istream& operator>>(std::istream&, poly&);
 };
@@ -41,10 +74,14 @@ poly::poly()
 { }
 
 poly::poly(const std::string& args) {
-	std::istringstream stream(args);
-	insert(stream);
+	poly_kernels::char_source src(args.data(), args.data() + args.size());
+	*this = poly( poly_kernels::parse(src) );
 }
 
+poly::poly(const poly_kernels::terms& argt) :
+_poly(argt.cbegin(), argt.cend())
+{ }
+
 poly::poly(const poly& argp) :
 _poly(argp._poly)
 { }
@@ -54,9 +91,8 @@ _poly( std::move(argp._poly) )
 { }
 
 void poly::insert(std::istream& stream) {
-	int co, exp;
-	while (stream >> co >> exp)
-		insert(co, exp);
+	poly_kernels::stream_source src(stream);
+	*this = poly( poly_kernels::merge_sum(terms(), poly_kernels::parse(src)) );
 }
 
 void poly::insert(int co, int exp) {
@@ -89,22 +125,209 @@ poly& poly::operator-=(const poly& argp) {
 }
 
 poly poly::operator*(const poly& argp) const {
-	poly new_poly;
-	for (const auto& kv1: _poly) {
-		int co1 = kv1.second, e1 = kv1.first;
-		for (const auto& kv2: argp._poly) {
-			int co2 = kv2.second, e2 = kv2.first;
-			new_poly.insert(co1*co2, e1+e2);
-		}
-	}
-	
-	return new_poly;
+	return poly( poly_kernels::multiply(terms(), argp.terms()) );
 }
 
 poly& poly::operator*=(const poly& argp) {
 	return *this = *this * argp;
 }
 
+bool poly::zero() const {
+	return _poly.empty();
+}
+
+int poly::degree() const {
+	return zero() ? -1 : _poly.crbegin()->first;
+}
+
+int poly::lead() const {
+	return zero() ? 0 : _poly.crbegin()->second;
+}
+
+poly_kernels::terms poly::terms() const {
+	return poly_kernels::terms(_poly.cbegin(), _poly.cend());
+}
+
+int poly::low() const {
+	return zero() ? 0 : _poly.cbegin()->first;
+}
+
+int poly::int_gcd(int a, int b) {
+	a = std::abs(a);
+	b = std::abs(b);
+	
+	while (b) {
+		int r = a % b;
+		a = b;
+		b = r;
+	}
+	
+	return a;
+}
+
+int poly::content() const {
+	int g = 0;
+	for (const auto& kv: _poly) {
+		g = int_gcd(g, kv.second);
+		if (g == 1) break;
+	}
+	
+	return g;
+}
+
+void poly::scale(int factor) {
+	if (factor == 0)
+		_poly.clear();
+	
+	for (auto& kv: _poly)
+		kv.second = poly_kernels::narrow(static_cast<long long>(kv.second) * factor);
+}
+
+void poly::divide_exact(int divisor) {
+	for (auto& kv: _poly)
+		kv.second /= divisor;
+}
+
+void poly::sub_mul(const poly& argp, int coeff, int exp) {
+	for (const auto& kv: argp._poly) {
+		long long co = -static_cast<long long>(coeff) * kv.second;
+		auto iter = _poly.find(kv.first + exp);
+		
+		if (iter == _poly.end())
+			_poly.emplace(kv.first + exp, poly_kernels::narrow(co));
+		else if ((iter->second = poly_kernels::narrow(iter->second + co)) == 0)
+			_poly.erase(iter);
+	}
+}
+
+void poly::long_div(const poly& argp, poly& quot, poly& rem) const {
+	int d = argp.degree(), lc = argp.lead();
+	poly q, r(*this);
+	
+	while (!r.zero() && r.degree() >= d) {
+		int rc = r.lead(), e = r.degree() - d;
+		if (rc % lc != 0)
+			throw std::domain_error
+			(
+				"inexact division: " + std::to_string(rc) 
+				+ " not divisible by " + std::to_string(lc)
+			);
+		
+		q._poly.emplace_hint(q._poly.begin(), e, rc / lc);
+		r.sub_mul(argp, rc / lc, e);
+	}
+	
+	quot = std::move(q);
+	rem = std::move(r);
+}
+
+void poly::newton_div(const poly& argp, poly& quot, poly& rem) const {
+	poly_kernels::terms q, r;
+	poly_kernels::newton_divide(terms(), argp.terms(), q, r);
+	
+	quot = poly(q);
+	rem = poly(r);
+}
+
+void poly::divmod(const poly& argp, poly& quot, poly& rem) const {
+	if (argp.zero())
+		throw std::domain_error
+		(
+			"division by zero polynomial"
+		);
+	
+	int n = degree(), m = argp.degree(), lc = argp.lead();
+	
+	if ((lc == 1 || lc == -1) && n-m+1 >= newton_cutoff 
+		&& low() >= 0 && argp.low() >= 0)
+		newton_div(argp, quot, rem);
+	else
+		long_div(argp, quot, rem);
+}
+
+poly poly::operator/(const poly& argp) const {
+	poly quot, rem;
+	divmod(argp, quot, rem);
+	return quot;
+}
+
+poly& poly::operator/=(const poly& argp) {
+	return *this = *this / argp;
+}
+
+poly poly::operator%(const poly& argp) const {
+	poly quot, rem;
+	divmod(argp, quot, rem);
+	return rem;
+}
+
+poly& poly::operator%=(const poly& argp) {
+	return *this = *this % argp;
+}
+
+poly poly::pow(unsigned e) const {
+	poly result, base(*this);
+	result.insert(1, 0);
+	
+	while (e) {
+		if (e & 1) result *= base;
+		if (e >>= 1) base *= base;
+	}
+	
+	return result;
+}
+
+poly poly::pow(unsigned e, const poly& mod) const {
+	poly result, base(*this % mod);
+	result.insert(1, 0);
+	result %= mod;
+	
+	while (e) {
+		if (e & 1) result = result * base % mod;
+		if (e >>= 1) base = base * base % mod;
+	}
+	
+	return result;
+}
+
+// the pseudo-remainder up to a constant factor: the content is taken out after
+// every step, or the coefficients grow exponentially with the degree
+poly poly::prem(const poly& argp) const {
+	int d = argp.degree(), lc = argp.lead();
+	poly r(*this);
+	
+	while (!r.zero() && r.degree() >= d) {
+		int rc = r.lead(), g = int_gcd(rc, lc);
+		r.scale(lc / g);
+		r.sub_mul(argp, rc / g, r.degree() - d);
+		if (!r.zero()) r.divide_exact(r.content());
+	}
+	
+	return r;
+}
+
+poly gcd(const poly& argp1, const poly& argp2) {
+	if (argp1.zero() && argp2.zero())
+		return poly();
+	
+	int c = poly::int_gcd(argp1.content(), argp2.content());
+	poly a(argp1), b(argp2);
+	
+	if (a.degree() < b.degree())
+		std::swap(a, b);
+	if (!a.zero()) a.divide_exact(a.content());
+	if (!b.zero()) b.divide_exact(b.content());
+	
+	while (!b.zero()) {
+		poly r = a.prem(b);
+		a = std::move(b);
+		b = std::move(r);
+	}
+	
+	a.scale(a.lead() < 0 ? -c : c);
+	return a;
+}
+
 poly poly::operator-() const {
 	return poly() - *this;
 }
@@ -117,17 +340,11 @@ poly& poly::operator=(poly&& argp) {
 }
 
 std::ostream& operator<<(std::ostream& out, const poly& argp) {
-	auto iter = argp._poly.crbegin(), end = argp._poly.crend();
-	
-	if (iter == end)
-		out << "0 0";
-	else {
-		while (iter != end) {
-			out << iter->second << ' ' << iter->first;
-			if (++iter != end) out << ' ';
-		}
-	}
+	poly_kernels::term_writer writer(out);
+	for (auto iter = argp._poly.crbegin(); iter != argp._poly.crend(); ++iter)
+		writer.put(iter->second, iter->first);
 	
+	writer.flush();
 	return out;
 }
 
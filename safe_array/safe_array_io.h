@@ -0,0 +1,335 @@
+#ifndef SAFE_ARRAY_IO
+#define SAFE_ARRAY_IO
+
+#include <ostream>
+#include <istream>
+#include <string>
+#include <utility>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include "safe_array.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SAFE_ARRAY_MMAP
+#endif
+
+// 64 bytes, so the payload of a mapped file stays 64-byte aligned
+struct safe_array_header {
+	char magic[8];
+	std::uint32_t version, order;
+	std::uint32_t type, elem_size;
+	std::int32_t lo, hi;
+	char reserved[32];
+};
+
+static_assert(sizeof(safe_array_header) == 64, "safe_array_header must be 64 bytes");
+
+const char safe_array_magic[8] = { 'S', 'A', 'F', 'E', 'A', 'R', 'R', '\0' };
+const std::uint32_t safe_array_version = 1;
+const std::uint32_t safe_array_order = 0x01020304;
+
+template <typename T>
+constexpr std::uint32_t safe_array_type_tag() {
+	return std::is_floating_point<T>::value ? 3 :
+	       std::is_signed<T>::value ? 1 :
+	       std::is_unsigned<T>::value ? 2 : 0;
+}
+
+template <typename T>
+safe_array_header safe_array_make_header(int low, int high) {
+	safe_array_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, safe_array_magic, sizeof(header.magic));
+
+	header.version = safe_array_version;
+	header.order = safe_array_order;
+	header.type = safe_array_type_tag<T>();
+	header.elem_size = sizeof(T);
+	header.lo = low;
+	header.hi = high;
+
+	return header;
+}
+
+template <typename T>
+std::size_t safe_array_check_header(const safe_array_header& header) {
+	if (std::memcmp(header.magic, safe_array_magic, sizeof(header.magic)) != 0)
+		throw std::domain_error
+		(
+			"not a safe_array file"
+		);
+
+	if (header.version != safe_array_version || header.order != safe_array_order)
+		throw std::domain_error
+		(
+			"unsupported safe_array version or byte order"
+		);
+
+	if (header.type != safe_array_type_tag<T>() || header.elem_size != sizeof(T))
+		throw std::domain_error
+		(
+			"element type mismatch: stored size " + std::to_string(header.elem_size)
+		);
+
+	long long size = static_cast<long long>(header.hi) - header.lo + 1;
+	if (size < 0)
+		throw std::length_error
+		(
+			"invalid bounds: " + std::to_string(size)
+		);
+
+	return static_cast<std::size_t>(size);
+}
+
+template <typename T, typename Access, typename Alloc>
+void write_binary(std::ostream& out, const safe_array<T, Access, Alloc>& sa) {
+	static_assert(std::is_trivially_copyable<T>::value, "binary I/O needs a trivially copyable type");
+
+	safe_array_header header = safe_array_make_header<T>(sa.lo(), sa.hi());
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!sa.empty())
+		out.write(reinterpret_cast<const char*>(sa.data()), sizeof(T) * sa.size());
+}
+
+template <typename T, typename Access, typename Alloc>
+void read_binary(std::istream& in, safe_array<T, Access, Alloc>& sa) {
+	static_assert(std::is_trivially_copyable<T>::value, "binary I/O needs a trivially copyable type");
+
+	safe_array_header header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return;
+
+	std::size_t size = safe_array_check_header<T>(header);
+
+	// an empty array has no constructor that keeps its lower bound
+	if (size == 0) {
+		safe_array<T, Access, Alloc> new_arr(header.lo, header.lo, sa.get_allocator());
+		new_arr.resize(0);
+		sa = std::move(new_arr);
+		return;
+	}
+
+	safe_array<T, Access, Alloc> new_arr(header.lo, header.hi, sa.get_allocator());
+	if (!in.read(reinterpret_cast<char*>(new_arr.data()), sizeof(T) * size))
+		return;
+
+	sa = std::move(new_arr);
+}
+
+#ifdef SAFE_ARRAY_MMAP
+
+// const T maps the file read-only; non-const T maps it copy-on-write, so
+// writes stay private to the process and never reach the file
+template <typename T, typename Access = SAFE_ARRAY_ACCESS>
+class mapped_array {
+	static_assert(std::is_trivially_copyable<T>::value, "mapped_array needs a trivially copyable type");
+
+private:
+	safe_span<T, Access> _span;
+	void *_map;
+	std::size_t _len;
+
+	void unmap();
+
+public:
+	typedef typename std::remove_const<T>::type value_type;
+	typedef safe_span<T, Access> span_type;
+	typedef typename span_type::iterator iterator;
+
+	mapped_array();
+	explicit mapped_array(const std::string&);
+	mapped_array(const mapped_array&) = delete;
+	mapped_array(mapped_array&&);
+
+	T* operator+(int) const;
+	T& operator[](int) const;
+	T& at(int) const;
+
+	int lo() const;
+	int hi() const;
+	int size() const;
+	bool empty() const;
+	T* data() const;
+
+	iterator begin() const;
+	iterator end() const;
+
+	span_type span() const;
+	span_type range(int, int) const;
+	operator span_type() const;
+
+	mapped_array& operator=(const mapped_array&) = delete;
+	mapped_array& operator=(mapped_array&&);
+
+	~mapped_array();
+};
+
+template <typename T, typename Access>
+mapped_array<T, Access>::mapped_array() :
+_map(nullptr), _len(0)
+{ }
+
+template <typename T, typename Access>
+mapped_array<T, Access>::mapped_array(const std::string& path) :
+_map(nullptr), _len(0)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::system_error(errno, std::generic_category(), "open " + path);
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0) {
+		int err = errno;
+		::close(fd);
+		throw std::system_error(err, std::generic_category(), "stat " + path);
+	}
+
+	_len = static_cast<std::size_t>(st.st_size);
+	if (_len < sizeof(safe_array_header)) {
+		::close(fd);
+		throw std::domain_error
+		(
+			"truncated safe_array file: " + path
+		);
+	}
+
+	int prot = std::is_const<T>::value ? PROT_READ : PROT_READ | PROT_WRITE;
+	void *map = ::mmap(nullptr, _len, prot, MAP_PRIVATE, fd, 0);
+	int err = errno;
+	::close(fd);
+
+	if (map == MAP_FAILED)
+		throw std::system_error(err, std::generic_category(), "mmap " + path);
+	_map = map;
+
+	try {
+		const safe_array_header& header = *static_cast<const safe_array_header*>(_map);
+		std::size_t size = safe_array_check_header<value_type>(header);
+
+		if (size > (_len - sizeof(header)) / sizeof(T))
+			throw std::domain_error
+			(
+				"truncated safe_array file: " + path
+			);
+
+		T *data = reinterpret_cast<T*>( static_cast<char*>(_map) + sizeof(header) );
+		_span = span_type(data, header.lo, header.hi);
+	} catch (...) {
+		unmap();
+		throw;
+	}
+}
+
+template <typename T, typename Access>
+mapped_array<T, Access>::mapped_array(mapped_array&& ma) :
+_span(ma._span), _map(ma._map), _len(ma._len)
+{
+	ma._span = span_type();
+	ma._map = nullptr;
+	ma._len = 0;
+}
+
+template <typename T, typename Access>
+void mapped_array<T, Access>::unmap() {
+	if (_map != nullptr)
+		::munmap(_map, _len);
+
+	_span = span_type();
+	_map = nullptr;
+	_len = 0;
+}
+
+template <typename T, typename Access>
+inline T* mapped_array<T, Access>::operator+(int offset) const {
+	return _span + offset;
+}
+
+template <typename T, typename Access>
+inline T& mapped_array<T, Access>::operator[](int i) const {
+	return _span[i];
+}
+
+template <typename T, typename Access>
+inline T& mapped_array<T, Access>::at(int i) const {
+	return _span.at(i);
+}
+
+template <typename T, typename Access>
+inline int mapped_array<T, Access>::lo() const {
+	return _span.lo();
+}
+
+template <typename T, typename Access>
+inline int mapped_array<T, Access>::hi() const {
+	return _span.hi();
+}
+
+template <typename T, typename Access>
+inline int mapped_array<T, Access>::size() const {
+	return _span.size();
+}
+
+template <typename T, typename Access>
+inline bool mapped_array<T, Access>::empty() const {
+	return _span.empty();
+}
+
+template <typename T, typename Access>
+inline T* mapped_array<T, Access>::data() const {
+	return _span.data();
+}
+
+template <typename T, typename Access>
+inline typename mapped_array<T, Access>::iterator mapped_array<T, Access>::begin() const {
+	return _span.begin();
+}
+
+template <typename T, typename Access>
+inline typename mapped_array<T, Access>::iterator mapped_array<T, Access>::end() const {
+	return _span.end();
+}
+
+template <typename T, typename Access>
+inline safe_span<T, Access> mapped_array<T, Access>::span() const {
+	return _span;
+}
+
+template <typename T, typename Access>
+safe_span<T, Access> mapped_array<T, Access>::range(int low, int high) const {
+	return _span.range(low, high);
+}
+
+template <typename T, typename Access>
+mapped_array<T, Access>::operator safe_span<T, Access>() const {
+	return _span;
+}
+
+template <typename T, typename Access>
+mapped_array<T, Access>& mapped_array<T, Access>::operator=(mapped_array&& rhs) {
+	if (this != &rhs) {
+		unmap();
+		std::swap(_span, rhs._span);
+		std::swap(_map, rhs._map);
+		std::swap(_len, rhs._len);
+	}
+
+	return *this;
+}
+
+template <typename T, typename Access>
+mapped_array<T, Access>::~mapped_array() {
+	unmap();
+}
+
+#endif
+
+#endif
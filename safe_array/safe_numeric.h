@@ -0,0 +1,361 @@
+#ifndef SAFE_NUMERIC
+#define SAFE_NUMERIC
+
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include "safe_array.h"
+#include "thread_pool.h"
+
+// Bulk operations over anything exposing lo(), size() and data(): safe_array,
+// safe_span, mapped_array. Operands are matched position by position over their
+// whole [lo, hi], so differently based arrays combine naturally; take a range()
+// to work on part of one. reduce, dot and the parallel scans regroup operations,
+// so op must be associative (and commutative for reduce).
+namespace safe_numeric {
+
+struct sequenced_policy { };
+
+struct parallel_policy {
+	unsigned threads;
+
+	parallel_policy operator()(unsigned n) const { return parallel_policy{n}; }
+};
+
+const sequenced_policy seq = { };
+const parallel_policy par = { 0 };
+
+const std::size_t grain = 1 << 16;
+const std::size_t lanes = 8;
+
+template <typename P> struct is_policy : std::false_type { };
+template <> struct is_policy<sequenced_policy> : std::true_type { };
+template <> struct is_policy<parallel_policy> : std::true_type { };
+
+template <typename P, typename R = void>
+struct if_policy : std::enable_if<is_policy<typename std::decay<P>::type>::value, R> { };
+
+template <typename P, typename R = void>
+struct if_not_policy : std::enable_if<!is_policy<typename std::decay<P>::type>::value, R> { };
+
+template <typename Range>
+struct element {
+	typedef typename std::remove_cv<typename std::remove_reference
+		<decltype(*std::declval<Range&>().data())>::type>::type type;
+};
+
+inline unsigned threads(const sequenced_policy&, std::size_t) {
+	return 1;
+}
+
+// par with no count uses the whole shared pool
+inline unsigned threads(const parallel_policy& policy, std::size_t n) {
+	std::size_t t = policy.threads ? policy.threads : thread_pool::shared().size();
+	if (t > n / grain) t = n / grain;
+
+	return t ? static_cast<unsigned>(t) : 1;
+}
+
+// task(0) .. task(n-1) on the shared pool, so a parallel call costs a few
+// queue pushes rather than thread creation; the first exception is rethrown
+template <typename F>
+void run(unsigned n, F task) {
+	thread_pool::shared().parallel_for(static_cast<int>(n), [&](int t) {
+		task(static_cast<unsigned>(t));
+	});
+}
+
+template <typename F>
+void chunked(unsigned n, std::size_t size, F task) {
+	run(n, [&](unsigned c) {
+		task(c, size * c / n, size * (c+1) / n);
+	});
+}
+
+template <typename A, typename B>
+std::size_t matched_size(const A& a, const B& b) {
+	if (a.size() != b.size())
+		throw std::length_error
+		(
+			"size mismatch: " + std::to_string(a.size()) + " and " + std::to_string(b.size())
+		);
+
+	return a.size() > 0 ? static_cast<std::size_t>(a.size()) : 0;
+}
+
+template <typename T, typename U, typename Op>
+T reduce_kernel(const U* in, std::size_t n, T init, Op op, std::true_type) {
+	if (n < 2*lanes) {
+		for (std::size_t i = 0; i < n; ++i)
+			init = op(init, in[i]);
+		return init;
+	}
+
+	// independent accumulators break the dependency chain, so the loop vectorizes
+	T acc[lanes];
+	for (std::size_t k = 0; k < lanes; ++k)
+		acc[k] = in[k];
+
+	std::size_t i = lanes;
+	for (; i + lanes <= n; i += lanes)
+		for (std::size_t k = 0; k < lanes; ++k)
+			acc[k] = op(acc[k], in[i+k]);
+
+	for (std::size_t k = 0; k < lanes; ++k)
+		init = op(init, acc[k]);
+	for (; i < n; ++i)
+		init = op(init, in[i]);
+
+	return init;
+}
+
+template <typename T, typename U, typename Op>
+T reduce_kernel(const U* in, std::size_t n, T init, Op op, std::false_type) {
+	for (std::size_t i = 0; i < n; ++i)
+		init = op(init, in[i]);
+
+	return init;
+}
+
+template <typename T, typename U, typename Op>
+T reduce_kernel(const U* in, std::size_t n, T init, Op op) {
+	return reduce_kernel(in, n, std::move(init), op, std::integral_constant<bool,
+		std::is_arithmetic<T>::value && std::is_arithmetic<U>::value>());
+}
+
+template <typename T, typename A, typename B>
+T dot_kernel(const A* a, const B* b, std::size_t n, std::true_type) {
+	T acc[lanes] = { };
+	std::size_t i = 0;
+
+	for (; i + lanes <= n; i += lanes)
+		for (std::size_t k = 0; k < lanes; ++k)
+			acc[k] += a[i+k] * b[i+k];
+
+	T sum = T();
+	for (std::size_t k = 0; k < lanes; ++k)
+		sum += acc[k];
+	for (; i < n; ++i)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+template <typename T, typename A, typename B>
+T dot_kernel(const A* a, const B* b, std::size_t n, std::false_type) {
+	T sum = T();
+	for (std::size_t i = 0; i < n; ++i)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+template <typename T, typename U, typename Op>
+void scan_kernel(T* out, const U* in, std::size_t n, Op op, bool inclusive, bool seeded, T acc) {
+	for (std::size_t i = 0; i < n; ++i) {
+		T x = in[i];
+		if (inclusive) {
+			acc = seeded ? op(acc, x) : x;
+			out[i] = acc;
+		} else {
+			out[i] = acc;
+			acc = op(acc, x);
+		}
+		seeded = true;
+	}
+}
+
+// blocked two-pass scan: reduce each chunk, scan the chunk totals, then
+// rescan every chunk seeded with the total of everything before it
+template <typename Policy, typename T, typename U, typename Op>
+void scan(const Policy& policy, T* out, const U* in, std::size_t n, Op op, bool inclusive, bool seeded, T init) {
+	unsigned t = threads(policy, n);
+	if (t <= 1) {
+		scan_kernel(out, in, n, op, inclusive, seeded, init);
+		return;
+	}
+
+	std::vector<T> totals(t);
+	chunked(t, n, [&](unsigned c, std::size_t lo, std::size_t hi) {
+		if (c + 1 < t)
+			totals[c] = reduce_kernel(in + lo + 1, hi - lo - 1, T(in[lo]), op, std::false_type());
+	});
+
+	std::vector<T> seeds(t, init);
+	for (unsigned c = 1; c < t; ++c)
+		seeds[c] = c > 1 || seeded ? op(seeds[c-1], totals[c-1]) : totals[c-1];
+
+	chunked(t, n, [&](unsigned c, std::size_t lo, std::size_t hi) {
+		scan_kernel(out + lo, in + lo, hi - lo, op, inclusive, c > 0 || seeded, seeds[c]);
+	});
+}
+
+template <typename Policy, typename Range, typename T>
+typename if_policy<Policy>::type fill(const Policy& policy, Range&& r, const T& value) {
+	typedef typename element<Range>::type E;
+	std::size_t n = matched_size(r, r);
+	auto *dst = r.data();
+	const E v(value);
+
+	chunked(threads(policy, n), n, [&](unsigned, std::size_t lo, std::size_t hi) {
+		for (std::size_t i = lo; i < hi; ++i)
+			dst[i] = v;
+	});
+}
+
+template <typename Range, typename T>
+typename if_not_policy<Range>::type fill(Range&& r, const T& value) {
+	fill(seq, std::forward<Range>(r), value);
+}
+
+template <typename Policy, typename Out, typename In, typename F>
+typename if_policy<Policy>::type transform(const Policy& policy, Out&& out, const In& in, F f) {
+	std::size_t n = matched_size(out, in);
+	auto *dst = out.data();
+	auto *src = in.data();
+
+	chunked(threads(policy, n), n, [&](unsigned, std::size_t lo, std::size_t hi) {
+		for (std::size_t i = lo; i < hi; ++i)
+			dst[i] = f(src[i]);
+	});
+}
+
+template <typename Out, typename In, typename F>
+typename if_not_policy<Out>::type transform(Out&& out, const In& in, F f) {
+	transform(seq, std::forward<Out>(out), in, f);
+}
+
+template <typename Policy, typename Out, typename A, typename B, typename F>
+typename if_policy<Policy>::type transform(const Policy& policy, Out&& out, const A& a, const B& b, F f) {
+	std::size_t n = matched_size(out, a);
+	matched_size(a, b);
+	auto *dst = out.data();
+	auto *pa = a.data();
+	auto *pb = b.data();
+
+	chunked(threads(policy, n), n, [&](unsigned, std::size_t lo, std::size_t hi) {
+		for (std::size_t i = lo; i < hi; ++i)
+			dst[i] = f(pa[i], pb[i]);
+	});
+}
+
+template <typename Out, typename A, typename B, typename F>
+typename if_not_policy<Out>::type transform(Out&& out, const A& a, const B& b, F f) {
+	transform(seq, std::forward<Out>(out), a, b, f);
+}
+
+template <typename Policy, typename Range, typename T, typename Op>
+typename if_policy<Policy, T>::type reduce(const Policy& policy, const Range& r, T init, Op op) {
+	std::size_t n = matched_size(r, r);
+	auto *src = r.data();
+	unsigned t = threads(policy, n);
+
+	if (t <= 1)
+		return reduce_kernel(src, n, std::move(init), op);
+
+	std::vector<T> partial(t);
+	chunked(t, n, [&](unsigned c, std::size_t lo, std::size_t hi) {
+		partial[c] = reduce_kernel(src + lo + 1, hi - lo - 1, T(src[lo]), op);
+	});
+
+	return reduce_kernel(partial.data(), t, std::move(init), op, std::false_type());
+}
+
+template <typename Policy, typename Range, typename T>
+typename if_policy<Policy, T>::type reduce(const Policy& policy, const Range& r, T init) {
+	return reduce(policy, r, std::move(init), std::plus<T>());
+}
+
+template <typename Range, typename T, typename Op>
+typename if_not_policy<Range, T>::type reduce(const Range& r, T init, Op op) {
+	return reduce(seq, r, std::move(init), op);
+}
+
+template <typename Range, typename T>
+typename if_not_policy<Range, T>::type reduce(const Range& r, T init) {
+	return reduce(seq, r, std::move(init), std::plus<T>());
+}
+
+template <typename A, typename B>
+struct dot_type {
+	typedef typename std::decay<decltype(std::declval<typename element<A>::type>()
+		* std::declval<typename element<B>::type>())>::type type;
+};
+
+template <typename Policy, typename A, typename B>
+typename if_policy<Policy, typename dot_type<A, B>::type>::type 
+dot(const Policy& policy, const A& a, const B& b) {
+	typedef typename dot_type<A, B>::type T;
+	typedef std::integral_constant<bool, std::is_arithmetic<T>::value> simd;
+
+	std::size_t n = matched_size(a, b);
+	auto *pa = a.data();
+	auto *pb = b.data();
+	unsigned t = threads(policy, n);
+
+	if (t <= 1)
+		return dot_kernel<T>(pa, pb, n, simd());
+
+	std::vector<T> partial(t);
+	chunked(t, n, [&](unsigned c, std::size_t lo, std::size_t hi) {
+		partial[c] = dot_kernel<T>(pa + lo, pb + lo, hi - lo, simd());
+	});
+
+	return reduce_kernel(partial.data(), t, T(), std::plus<T>(), std::false_type());
+}
+
+template <typename A, typename B>
+typename if_not_policy<A, typename dot_type<A, B>::type>::type 
+dot(const A& a, const B& b) {
+	return dot(seq, a, b);
+}
+
+template <typename Policy, typename Out, typename In, typename Op>
+typename if_policy<Policy>::type inclusive_scan(const Policy& policy, Out&& out, const In& in, Op op) {
+	typedef typename element<Out>::type T;
+	scan(policy, out.data(), in.data(), matched_size(out, in), op, true, false, T());
+}
+
+template <typename Policy, typename Out, typename In>
+typename if_policy<Policy>::type inclusive_scan(const Policy& policy, Out&& out, const In& in) {
+	inclusive_scan(policy, std::forward<Out>(out), in, std::plus<typename element<Out>::type>());
+}
+
+template <typename Out, typename In, typename Op>
+typename if_not_policy<Out>::type inclusive_scan(Out&& out, const In& in, Op op) {
+	inclusive_scan(seq, std::forward<Out>(out), in, op);
+}
+
+template <typename Out, typename In>
+typename if_not_policy<Out>::type inclusive_scan(Out&& out, const In& in) {
+	inclusive_scan(seq, std::forward<Out>(out), in, std::plus<typename element<Out>::type>());
+}
+
+template <typename Policy, typename Out, typename In, typename T, typename Op>
+typename if_policy<Policy>::type exclusive_scan(const Policy& policy, Out&& out, const In& in, T init, Op op) {
+	typedef typename element<Out>::type E;
+	scan(policy, out.data(), in.data(), matched_size(out, in), op, false, true, E(init));
+}
+
+template <typename Policy, typename Out, typename In, typename T>
+typename if_policy<Policy>::type exclusive_scan(const Policy& policy, Out&& out, const In& in, T init) {
+	exclusive_scan(policy, std::forward<Out>(out), in, init, std::plus<typename element<Out>::type>());
+}
+
+template <typename Out, typename In, typename T, typename Op>
+typename if_not_policy<Out>::type exclusive_scan(Out&& out, const In& in, T init, Op op) {
+	exclusive_scan(seq, std::forward<Out>(out), in, init, op);
+}
+
+template <typename Out, typename In, typename T>
+typename if_not_policy<Out>::type exclusive_scan(Out&& out, const In& in, T init) {
+	exclusive_scan(seq, std::forward<Out>(out), in, init, std::plus<typename element<Out>::type>());
+}
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+// g++ -std=c++11 -O2 -pthread -fsanitize=address,undefined safe_sort_test.cpp -o safe_sort_test
+// ./safe_sort_test
+//
+// sorts arrays holding NaNs through each path of the sort engine: the
+// network below network_max, pdq below radix_min and radix above it. NaNs
+// must end up last and everything before them in order
+
+#include <iostream>
+#include <limits>
+#include <random>
+#include <cstddef>
+#include "safe_array.h"
+
+namespace {
+
+template <typename T>
+bool check(int n, int nans, std::mt19937& gen) {
+	std::uniform_real_distribution<double> pick(-1000.0, 1000.0);
+	std::uniform_int_distribution<int> where(0, n-1);
+
+	safe_array<T> sa(0, n-1);
+	for (int i = 0; i < n; ++i)
+		sa[i] = T( pick(gen) );
+	for (int k = 0; k < nans; ++k)
+		sa[where(gen)] = k % 2 ? std::numeric_limits<T>::quiet_NaN() : -std::numeric_limits<T>::quiet_NaN();
+
+	int found = 0;
+	for (int i = 0; i < n; ++i)
+		found += sa[i] != sa[i];
+
+	sort(sa, n);
+
+	int i = 0;
+	for (; i < n && sa[i] == sa[i]; ++i)
+		if (i > 0 && sa[i] < sa[i-1])
+			return false;
+	for (int j = i; j < n; ++j)
+		if (sa[j] == sa[j])
+			return false;
+
+	return n - i == found;
+}
+
+}
+
+int main() {
+	const int sizes[] = { 2, 10, 16, 17, 30, 100, 200, 255, 256, 1000, 100000 };
+	const int nans[] = { 1, 2, 5, 50 };
+
+	std::mt19937 gen(20261019);
+	bool failed = false;
+
+	for (int n: sizes) {
+		for (int k: nans) {
+			if (!check<double>(n, k, gen) || !check<float>(n, k, gen) || !check<long double>(n, k, gen)) {
+				std::cerr << "unsorted: " << n << " elements, " << k << " NaNs\n";
+				failed = true;
+			}
+		}
+	}
+
+	return failed ? 1 : 0;
+}
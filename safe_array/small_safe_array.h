@@ -0,0 +1,589 @@
+#ifndef SMALL_SAFE_ARRAY
+#define SMALL_SAFE_ARRAY
+
+#include <ostream>
+#include <istream>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <initializer_list>
+#include <memory>
+#include <climits>
+#include "safe_array.h"
+
+// safe_array with room for N elements inside the object itself; it moves to
+// the heap only once it outgrows that, and never moves back
+template <typename T, int N, typename Access = SAFE_ARRAY_ACCESS, typename Alloc = aligned_allocator<T>>
+class small_safe_array {
+	static_assert(N > 0, "small_safe_array needs room for at least one element");
+
+private:
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<T> allocator_type;
+	typedef std::allocator_traits<allocator_type> alloc_traits;
+
+	int _lo, _hi, _cap;
+	allocator_type _alloc;
+	T *_arr;
+	alignas(T) unsigned char _buf[sizeof(T) * N];
+
+	T* inline_data();
+	const T* inline_data() const;
+	bool in_range(int) const;
+	int grow() const;
+	void check_resize(int) const;
+
+	T* acquire(int);
+	void release();
+	void reset();
+	void adopt(T*, int);
+	void reallocate(int);
+	void steal(small_safe_array&);
+
+public:
+	typedef T value_type;
+	typedef typename safe_array_iterator<T, Access>::type iterator;
+	typedef typename safe_array_iterator<const T, Access>::type const_iterator;
+	typedef safe_span<T, Access> span_type;
+	typedef safe_span<const T, Access> const_span_type;
+
+	static constexpr int inline_capacity = N;
+
+	small_safe_array();
+	explicit small_safe_array(const Alloc&);
+	small_safe_array(int);
+	small_safe_array(int, int, const Alloc& = Alloc());
+	small_safe_array(std::initializer_list<T>);
+	small_safe_array(const small_safe_array&);
+	small_safe_array(small_safe_array&&);
+
+	T* operator+(int);
+	const T* operator+(int) const;
+	T& operator[](int);
+	const T& operator[](int) const;
+	T& at(int);
+	const T& at(int) const;
+
+	int lo() const;
+	int hi() const;
+	int size() const;
+	int capacity() const;
+	bool empty() const;
+	bool is_inline() const;
+	T* data();
+	const T* data() const;
+	Alloc get_allocator() const;
+
+	void reserve(int);
+	void resize(int);
+	void resize(int, const T&);
+	void push_back(const T&);
+	void push_back(T&&);
+
+	template <typename... Args>
+	T& emplace_back(Args&&...);
+
+	iterator begin();
+	iterator end();
+	const_iterator begin() const;
+	const_iterator end() const;
+	const_iterator cbegin() const;
+	const_iterator cend() const;
+
+	span_type span();
+	const_span_type span() const;
+	span_type range(int, int);
+	const_span_type range(int, int) const;
+	operator span_type();
+	operator const_span_type() const;
+
+	void swap(small_safe_array&);
+
+	small_safe_array& operator=(const small_safe_array&);
+	small_safe_array& operator=(small_safe_array&&);
+
+	~small_safe_array();
+};
+
+template <typename T, int N, typename Access, typename Alloc>
+constexpr int small_safe_array<T, N, Access, Alloc>::inline_capacity;
+
+template <typename T, int N, typename Access, typename Alloc>
+inline T* small_safe_array<T, N, Access, Alloc>::inline_data() {
+	return reinterpret_cast<T*>(_buf);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline const T* small_safe_array<T, N, Access, Alloc>::inline_data() const {
+	return reinterpret_cast<const T*>(_buf);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline bool small_safe_array<T, N, Access, Alloc>::in_range(int i) const {
+	return safe_array_in_range(i, _lo, _hi);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+int small_safe_array<T, N, Access, Alloc>::grow() const {
+	if (_cap == INT_MAX)
+		throw std::length_error
+		(
+			"capacity overflow"
+		);
+
+	return _cap > INT_MAX/2 ? INT_MAX : 2*_cap;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::check_resize(int n) const {
+	if (n < 0 || static_cast<long long>(_lo) + n - 1 > INT_MAX)
+		throw std::length_error
+		(
+			"invalid size: " + std::to_string(n)
+		);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+T* small_safe_array<T, N, Access, Alloc>::acquire(int size) {
+	return size <= N ? inline_data() : alloc_traits::allocate(_alloc, size);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::release() {
+	safe_array_destroy(_arr, 0, size());
+	if (!is_inline())
+		alloc_traits::deallocate(_alloc, _arr, _cap);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::reset() {
+	_arr = inline_data();
+	_cap = N;
+	_lo = 0;
+	_hi = -1;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::adopt(T* arr, int cap) {
+	release();
+	_arr = arr;
+	_cap = cap;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::reallocate(int cap) {
+	T *arr = alloc_traits::allocate(_alloc, cap);
+	try {
+		safe_array_relocate(_arr, arr, size());
+	} catch (...) {
+		alloc_traits::deallocate(_alloc, arr, cap);
+		throw;
+	}
+
+	adopt(arr, cap);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::steal(small_safe_array& sa) {
+	if (sa.is_inline()) {
+		safe_array_relocate(sa._arr, inline_data(), sa.size());
+		_arr = inline_data();
+		_cap = N;
+		safe_array_destroy(sa._arr, 0, sa.size());
+	} else {
+		_arr = sa._arr;
+		_cap = sa._cap;
+	}
+
+	_lo = sa._lo;
+	_hi = sa._hi;
+	sa.reset();
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::small_safe_array() :
+_lo(0), _hi(-1), _cap(N), _arr( inline_data() )
+{ }
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::small_safe_array(const Alloc& alloc) :
+_lo(0), _hi(-1), _cap(N), _alloc(alloc), _arr( inline_data() )
+{ }
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::small_safe_array(int sz) :
+small_safe_array(0, sz-1)
+{ }
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::small_safe_array(int low, int high, const Alloc& alloc) :
+_lo(low), _hi(high), _cap( safe_array_checked_size(low, high) ), _alloc(alloc), _arr( acquire(_cap) )
+{
+	if (_cap < N) _cap = N;
+
+	try {
+		safe_array_construct(_arr, 0, size());
+	} catch (...) {
+		if (!is_inline())
+			alloc_traits::deallocate(_alloc, _arr, _cap);
+		throw;
+	}
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::small_safe_array(std::initializer_list<T> il) :
+_lo(0), _hi(static_cast<int>(il.size())-1), _cap( safe_array_checked_size(0, _hi) ), _arr( acquire(_cap) )
+{
+	if (_cap < N) _cap = N;
+
+	try {
+		safe_array_copy(il.begin(), _arr, size());
+	} catch (...) {
+		if (!is_inline())
+			alloc_traits::deallocate(_alloc, _arr, _cap);
+		throw;
+	}
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::small_safe_array(const small_safe_array& sa) :
+_lo(sa._lo), _hi(sa._hi), _cap( sa.size() > N ? sa.size() : N ),
+_alloc( alloc_traits::select_on_container_copy_construction(sa._alloc) ), _arr( acquire(_cap) )
+{
+	try {
+		safe_array_copy(sa._arr, _arr, size());
+	} catch (...) {
+		if (!is_inline())
+			alloc_traits::deallocate(_alloc, _arr, _cap);
+		throw;
+	}
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::small_safe_array(small_safe_array&& sa) :
+_lo(0), _hi(-1), _cap(N), _alloc( std::move(sa._alloc) ), _arr( inline_data() )
+{
+	steal(sa);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+T* small_safe_array<T, N, Access, Alloc>::operator+(int offset) {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!in_range(offset)))
+		safe_array_out_of_range("offset", offset);
+
+	return _arr + (offset-_lo);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+const T* small_safe_array<T, N, Access, Alloc>::operator+(int offset) const {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!in_range(offset)))
+		safe_array_out_of_range("offset", offset);
+
+	return _arr + (offset-_lo);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+T& small_safe_array<T, N, Access, Alloc>::operator[](int i) {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!in_range(i)))
+		safe_array_out_of_range("index", i);
+
+	return _arr[i-_lo];
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+const T& small_safe_array<T, N, Access, Alloc>::operator[](int i) const {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!in_range(i)))
+		safe_array_out_of_range("index", i);
+
+	return _arr[i-_lo];
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+T& small_safe_array<T, N, Access, Alloc>::at(int i) {
+	if (SAFE_ARRAY_UNLIKELY(!in_range(i)))
+		safe_array_out_of_range("index", i);
+
+	return _arr[i-_lo];
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+const T& small_safe_array<T, N, Access, Alloc>::at(int i) const {
+	if (SAFE_ARRAY_UNLIKELY(!in_range(i)))
+		safe_array_out_of_range("index", i);
+
+	return _arr[i-_lo];
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline int small_safe_array<T, N, Access, Alloc>::lo() const {
+	return _lo;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline int small_safe_array<T, N, Access, Alloc>::hi() const {
+	return _hi;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline int small_safe_array<T, N, Access, Alloc>::size() const {
+	return _hi-_lo+1;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline int small_safe_array<T, N, Access, Alloc>::capacity() const {
+	return _cap;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline bool small_safe_array<T, N, Access, Alloc>::empty() const {
+	return _hi < _lo;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline bool small_safe_array<T, N, Access, Alloc>::is_inline() const {
+	return _arr == inline_data();
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline T* small_safe_array<T, N, Access, Alloc>::data() {
+	return _arr;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline const T* small_safe_array<T, N, Access, Alloc>::data() const {
+	return _arr;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline Alloc small_safe_array<T, N, Access, Alloc>::get_allocator() const {
+	return Alloc(_alloc);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::reserve(int cap) {
+	if (cap > _cap)
+		reallocate(cap);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::resize(int n) {
+	check_resize(n);
+	if (n > _cap)
+		reallocate(n);
+
+	if (n > size())
+		safe_array_construct(_arr, size(), n);
+	else
+		safe_array_destroy(_arr, n, size());
+
+	_hi = _lo + n - 1;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::resize(int n, const T& value) {
+	check_resize(n);
+	if (n > _cap) {
+		T tmp(value);
+		reallocate(n);
+		safe_array_fill(_arr, size(), n, tmp);
+	} else if (n > size())
+		safe_array_fill(_arr, size(), n, value);
+	else
+		safe_array_destroy(_arr, n, size());
+
+	_hi = _lo + n - 1;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::push_back(const T& value) {
+	emplace_back(value);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::push_back(T&& value) {
+	emplace_back( std::move(value) );
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+template <typename... Args>
+T& small_safe_array<T, N, Access, Alloc>::emplace_back(Args&&... args) {
+	int n = size();
+	check_resize(n + 1);
+
+	if (n < _cap)
+		::new (static_cast<void*>(_arr + n)) T( std::forward<Args>(args)... );
+	else {
+		int cap = grow();
+		T *arr = alloc_traits::allocate(_alloc, cap);
+
+		try {
+			::new (static_cast<void*>(arr + n)) T( std::forward<Args>(args)... );
+		} catch (...) {
+			alloc_traits::deallocate(_alloc, arr, cap);
+			throw;
+		}
+
+		try {
+			safe_array_relocate(_arr, arr, n);
+		} catch (...) {
+			arr[n].~T();
+			alloc_traits::deallocate(_alloc, arr, cap);
+			throw;
+		}
+
+		adopt(arr, cap);
+	}
+
+	++_hi;
+	return _arr[n];
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline typename small_safe_array<T, N, Access, Alloc>::iterator small_safe_array<T, N, Access, Alloc>::begin() {
+	return safe_array_iterator<T, Access>::make(_arr, _lo, _lo, _hi);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline typename small_safe_array<T, N, Access, Alloc>::iterator small_safe_array<T, N, Access, Alloc>::end() {
+	return safe_array_iterator<T, Access>::make(_arr, _hi+1, _lo, _hi);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline typename small_safe_array<T, N, Access, Alloc>::const_iterator small_safe_array<T, N, Access, Alloc>::begin() const {
+	return safe_array_iterator<const T, Access>::make(_arr, _lo, _lo, _hi);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline typename small_safe_array<T, N, Access, Alloc>::const_iterator small_safe_array<T, N, Access, Alloc>::end() const {
+	return safe_array_iterator<const T, Access>::make(_arr, _hi+1, _lo, _hi);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline typename small_safe_array<T, N, Access, Alloc>::const_iterator small_safe_array<T, N, Access, Alloc>::cbegin() const {
+	return begin();
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline typename small_safe_array<T, N, Access, Alloc>::const_iterator small_safe_array<T, N, Access, Alloc>::cend() const {
+	return end();
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+safe_span<T, Access> small_safe_array<T, N, Access, Alloc>::span() {
+	return span_type(_arr, _lo, _hi);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+safe_span<const T, Access> small_safe_array<T, N, Access, Alloc>::span() const {
+	return const_span_type(_arr, _lo, _hi);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+safe_span<T, Access> small_safe_array<T, N, Access, Alloc>::range(int low, int high) {
+	return span().range(low, high);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+safe_span<const T, Access> small_safe_array<T, N, Access, Alloc>::range(int low, int high) const {
+	return span().range(low, high);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::operator safe_span<T, Access>() {
+	return span();
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::operator safe_span<const T, Access>() const {
+	return span();
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void small_safe_array<T, N, Access, Alloc>::swap(small_safe_array& sa) {
+	if (this == &sa)
+		return;
+
+	if (is_inline() || sa.is_inline()) {
+		small_safe_array tmp( std::move(sa) );
+		sa = std::move(*this);
+		*this = std::move(tmp);
+		return;
+	}
+
+	std::swap(_lo, sa._lo);
+	std::swap(_hi, sa._hi);
+	std::swap(_cap, sa._cap);
+	std::swap(_alloc, sa._alloc);
+	std::swap(_arr, sa._arr);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>&
+small_safe_array<T, N, Access, Alloc>::operator=(const small_safe_array& rhs) {
+	if (this == &rhs)
+		return *this;
+
+	if (size() == rhs.size()) {
+		std::copy(rhs._arr, rhs._arr + size(), _arr);
+		_lo = rhs._lo;
+		_hi = rhs._hi;
+	} else {
+		small_safe_array tmp(rhs);
+		*this = std::move(tmp);
+	}
+
+	return *this;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>&
+small_safe_array<T, N, Access, Alloc>::operator=(small_safe_array&& rhs) {
+	if (this != &rhs) {
+		release();
+		reset();
+		_alloc = std::move(rhs._alloc);
+		steal(rhs);
+	}
+
+	return *this;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+small_safe_array<T, N, Access, Alloc>::~small_safe_array() {
+	release();
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+inline void swap(small_safe_array<T, N, Access, Alloc>& lhs, small_safe_array<T, N, Access, Alloc>& rhs) {
+	lhs.swap(rhs);
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+std::ostream& operator<<(std::ostream& out, const small_safe_array<T, N, Access, Alloc>& sa) {
+	typedef typename small_safe_array<T, N, Access, Alloc>::const_iterator const_iterator;
+	for (const_iterator iter = sa.begin(); iter != sa.end(); ++iter) {
+		if (iter != sa.begin()) out << ' ';
+		out << *iter;
+	}
+
+	return out;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+std::istream& operator>>(std::istream& in, small_safe_array<T, N, Access, Alloc>& sa) {
+	typedef typename small_safe_array<T, N, Access, Alloc>::iterator iterator;
+	for (iterator iter = sa.begin(); iter != sa.end(); ++iter)
+		in >> *iter;
+
+	return in;
+}
+
+template <typename T, int N, typename Access, typename Alloc>
+void sort(small_safe_array<T, N, Access, Alloc>& sa, int sz) {
+	int cap = sz > sa.size() ? sa.size() : sz;
+
+	if (cap > 1)
+		safe_sort::sort(sa.data(), sa.data() + cap);
+}
+
+#endif
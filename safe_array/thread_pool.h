@@ -0,0 +1,358 @@
+#ifndef SAFE_THREAD_POOL
+#define SAFE_THREAD_POOL
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cerrno>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+// no pool grows past this, whatever it is asked for
+const unsigned safe_thread_max = 256;
+
+// a fixed set of workers, each with its own task deque. a worker pops from the
+// back of its own deque and, when that is empty, steals from the front of the
+// others, so a batch of uneven tiles still finishes at about the same time.
+//
+// a pool of size n runs n-1 worker threads; the thread that calls
+// parallel_for works through the batch as the n-th participant
+class thread_pool {
+private:
+	struct queue {
+		std::mutex lock;
+		std::deque< std::function<void()> > tasks;
+	};
+
+	std::vector< std::unique_ptr<queue> > _queues;
+	std::vector<std::thread> _threads;
+	std::mutex _idle_lock;
+	std::condition_variable _idle;
+	std::atomic<int> _queued;
+	unsigned _size;
+	bool _pin, _stop;
+
+	static const thread_pool*& owner();
+	static unsigned& index();
+
+	unsigned self() const;
+	void start(unsigned);
+	void stop();
+	void worker(unsigned);
+	void push(unsigned, std::function<void()>);
+	bool pop(unsigned, std::function<void()>&);
+	void pin(unsigned);
+
+public:
+	explicit thread_pool(unsigned=0, bool=true);
+	thread_pool(const thread_pool&) = delete;
+
+	unsigned size() const;
+	void resize(unsigned);
+
+	template <typename F>
+	void parallel_for(int, F);
+
+	template <typename F>
+	void parallel_range(int, int, F);
+
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	~thread_pool();
+
+	static thread_pool& shared();
+	static std::vector< std::vector<int> > numa_nodes();
+};
+
+// a thread count from the environment; 0, meaning the hardware concurrency,
+// when it is unset, not a whole number, not positive or out of range
+inline unsigned safe_thread_count(const char* text) {
+	if (text == nullptr) return 0;
+
+	char *end;
+	errno = 0;
+	long n = std::strtol(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || n <= 0) return 0;
+
+	return n > static_cast<long>(safe_thread_max) ? safe_thread_max : static_cast<unsigned>(n);
+}
+
+// the thread count comes from SAFE_MATRIX_THREADS, or the hardware when unset
+inline thread_pool& thread_pool::shared() {
+	static thread_pool pool( safe_thread_count(std::getenv("SAFE_MATRIX_THREADS")) );
+	return pool;
+}
+
+inline const thread_pool*& thread_pool::owner() {
+	static thread_local const thread_pool *pool = nullptr;
+	return pool;
+}
+
+inline unsigned& thread_pool::index() {
+	static thread_local unsigned i = 0;
+	return i;
+}
+
+// parses a sysfs cpu list such as "0-3,8-11"
+inline std::vector<int> safe_cpu_list(const std::string& list) {
+	std::vector<int> cpus;
+	std::stringstream in(list);
+	std::string range;
+
+	while (std::getline(in, range, ',')) {
+		int lo, hi;
+		char dash;
+		std::stringstream r(range);
+
+		if (!(r >> lo)) continue;
+		if (!(r >> dash >> hi)) hi = lo;
+		for (int cpu = lo; cpu <= hi; ++cpu)
+			cpus.push_back(cpu);
+	}
+
+	return cpus;
+}
+
+// one cpu list per NUMA node; empty when the system does not say
+inline std::vector< std::vector<int> > thread_pool::numa_nodes() {
+	std::vector< std::vector<int> > nodes;
+#ifdef __linux__
+	const std::string root = "/sys/devices/system/node/";
+	DIR *dir = ::opendir(root.c_str());
+	if (dir == nullptr) return nodes;
+
+	std::vector<int> ids;
+	while (dirent *entry = ::readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name.size() > 4 && name.compare(0, 4, "node") == 0
+			&& name.find_first_not_of("0123456789", 4) == std::string::npos)
+			ids.push_back(std::atoi(name.c_str() + 4));
+	}
+	::closedir(dir);
+	std::sort(ids.begin(), ids.end());
+
+	for (int id: ids) {
+		std::ifstream in(root + "node" + std::to_string(id) + "/cpulist");
+		std::string list;
+		if (std::getline(in, list)) {
+			std::vector<int> cpus = safe_cpu_list(list);
+			if (!cpus.empty())
+				nodes.push_back(cpus);
+		}
+	}
+#endif
+	return nodes;
+}
+
+// 0 picks the hardware concurrency. with pin set, workers are spread
+// round-robin over the NUMA nodes and each is bound to its node's cpus
+inline thread_pool::thread_pool(unsigned threads, bool pin) :
+_queued(0), _size(0), _pin(pin), _stop(false)
+{
+	start(threads);
+}
+
+inline unsigned thread_pool::size() const {
+	return _size;
+}
+
+// not safe while a parallel_for is running on this pool
+inline void thread_pool::resize(unsigned threads) {
+	stop();
+	start(threads);
+}
+
+inline unsigned thread_pool::self() const {
+	return owner() == this ? index() : 0;
+}
+
+inline void thread_pool::start(unsigned threads) {
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	if (threads == 0) threads = 1;
+	if (threads > safe_thread_max) threads = safe_thread_max;
+
+	_size = threads;
+	_stop = false;
+	_queues.clear();
+	for (unsigned i = 0; i < _size; ++i)
+		_queues.emplace_back(new queue);
+
+	_threads.reserve(_size - 1);
+	for (unsigned i = 1; i < _size; ++i) {
+		_threads.emplace_back(&thread_pool::worker, this, i);
+		if (_pin) pin(i);
+	}
+}
+
+inline void thread_pool::stop() {
+	{
+		std::lock_guard<std::mutex> guard(_idle_lock);
+		_stop = true;
+	}
+	_idle.notify_all();
+
+	for (auto& thread: _threads)
+		thread.join();
+	_threads.clear();
+}
+
+inline void thread_pool::pin(unsigned i) {
+#ifdef __linux__
+	static const std::vector< std::vector<int> > nodes = numa_nodes();
+	if (nodes.size() < 2) return;
+
+	const std::vector<int>& cpus = nodes[i % nodes.size()];
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu: cpus)
+		if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+
+	::pthread_setaffinity_np(_threads[i-1].native_handle(), sizeof(set), &set);
+#else
+	(void)i;
+#endif
+}
+
+inline void thread_pool::worker(unsigned i) {
+	owner() = this;
+	index() = i;
+	std::function<void()> task;
+
+	for (;;) {
+		if (pop(i, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_idle_lock);
+		_idle.wait(lock, [this] { return _stop || _queued > 0; });
+		if (_stop && _queued == 0) return;
+	}
+}
+
+inline void thread_pool::push(unsigned i, std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> guard(_queues[i]->lock);
+		_queues[i]->tasks.push_back( std::move(task) );
+	}
+	++_queued;
+}
+
+// own deque from the back, then the others' from the front
+inline bool thread_pool::pop(unsigned i, std::function<void()>& task) {
+	for (unsigned k = 0; k < _size; ++k) {
+		queue& q = *_queues[(i+k) % _size];
+		std::lock_guard<std::mutex> guard(q.lock);
+
+		if (!q.tasks.empty()) {
+			if (k == 0) {
+				task = std::move(q.tasks.back());
+				q.tasks.pop_back();
+			} else {
+				task = std::move(q.tasks.front());
+				q.tasks.pop_front();
+			}
+			--_queued;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// runs task(0) .. task(n-1) and returns once all have finished; the first
+// exception thrown by a task is rethrown here
+template <typename F>
+void thread_pool::parallel_for(int n, F task) {
+	if (n <= 0) return;
+	if (_size <= 1 || n == 1) {
+		for (int i = 0; i < n; ++i)
+			task(i);
+		return;
+	}
+
+	struct batch {
+		std::atomic<int> left;
+		std::mutex lock;
+		std::condition_variable done;
+		std::exception_ptr error;
+	} b;
+	b.left = n;
+
+	for (int i = 0; i < n; ++i)
+		push(i % _size, [&b, &task, i] {
+			try {
+				task(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> guard(b.lock);
+				if (!b.error) b.error = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> guard(b.lock);
+			if (--b.left == 0) b.done.notify_all();
+		});
+
+	{
+		std::lock_guard<std::mutex> guard(_idle_lock);
+	}
+	_idle.notify_all();
+
+	unsigned i = self();
+	std::function<void()> next;
+	while (b.left > 0) {
+		if (pop(i, next)) {
+			next();
+			next = nullptr;
+			continue;
+		}
+
+		// everything left of the batch is already running elsewhere
+		std::unique_lock<std::mutex> lock(b.lock);
+		b.done.wait(lock, [&b] { return b.left == 0; });
+	}
+
+	// the last task may still hold the lock it decremented under
+	std::lock_guard<std::mutex> guard(b.lock);
+	if (b.error) std::rethrow_exception(b.error);
+}
+
+// splits [0, n) into chunks of at least grain and calls task(begin, end) on
+// each; about four chunks per thread leaves room for stealing
+template <typename F>
+void thread_pool::parallel_range(int n, int grain, F task) {
+	if (n <= 0) return;
+	if (grain < 1) grain = 1;
+
+	int chunks = static_cast<int>(std::min<long long>(n / grain, 4LL * _size));
+	if (_size <= 1 || chunks <= 1) {
+		task(0, n);
+		return;
+	}
+
+	parallel_for(chunks, [&](int c) {
+		task(static_cast<int>(static_cast<long long>(n) * c / chunks),
+		     static_cast<int>(static_cast<long long>(n) * (c+1) / chunks));
+	});
+}
+
+inline thread_pool::~thread_pool() {
+	stop();
+}
+
+#endif
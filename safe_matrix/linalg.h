@@ -0,0 +1,614 @@
+#ifndef SAFE_LINALG
+#define SAFE_LINALG
+
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+#include "safe_matrix.h"
+
+// dense factorizations in the LAPACK mould: each sweeps the matrix a panel
+// of columns at a time and pushes everything outside the panel through the
+// blocked gemm, so nearly all of the O(n^3) work runs at gemm speed on the
+// shared pool. the factors overwrite a copy of the input; results of solve()
+// and inverse() are 0-based
+namespace safe_linalg {
+
+// width of the LU and Cholesky panels
+const int block = 128;
+
+// the triangular solves work through diagonal blocks this size unblocked
+// and hand the rest to gemm
+const int tri_block = 32;
+
+// the diagonal block of a triangular solve, one row of B at a time; each
+// row is a chain of axpys over the solved rows above (below, for upper)
+template <typename T>
+void trsm_block(bool lower, bool unit, int n, int nrhs,
+                const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa, T* b, std::ptrdiff_t ldb)
+{
+	for (int s = 0; s < n; ++s) {
+		int i = lower ? s : n-1 - s;
+		int p_lo = lower ? 0 : i+1, p_hi = lower ? i : n;
+		T *b_row = b + i*ldb;
+
+		for (int p = p_lo; p < p_hi; ++p) {
+			const T a_ip = a[i*rsa + p*csa];
+			const T *x = b + p*ldb;
+			if (a_ip != T(0))
+				for (int j = 0; j < nrhs; ++j)
+					b_row[j] -= a_ip * x[j];
+		}
+
+		if (!unit) {
+			const T d = a[i*rsa + i*csa];
+			for (int j = 0; j < nrhs; ++j)
+				b_row[j] /= d;
+		}
+	}
+}
+
+// B = A^-1 B for an n x n triangle of the strided A and a row-major n x nrhs
+// B. each block of rows is solved on its own, then removed from the rows
+// still to come with one gemm
+template <typename T>
+void trsm(bool lower, bool unit, int n, int nrhs,
+          const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa, T* b, std::ptrdiff_t ldb)
+{
+	for (int s = 0; s < n; s += tri_block) {
+		int nb = std::min(tri_block, n - s), rest = n - s - nb;
+		int i = lower ? s : rest;
+
+		trsm_block(lower, unit, nb, nrhs, a + i*rsa + i*csa, rsa, csa, b + i*ldb, ldb);
+		if (rest == 0)
+			break;
+
+		if (lower)
+			safe_gemm::gemm(rest, nrhs, nb, T(-1), a + (i+nb)*rsa + i*csa, rsa, csa,
+			                b + i*ldb, ldb, 1, T(1), b + (i+nb)*ldb, ldb);
+		else
+			safe_gemm::gemm(rest, nrhs, nb, T(-1), a + i*csa, rsa, csa,
+			                b + i*ldb, ldb, 1, T(1), b, ldb);
+	}
+}
+
+// X = X L'^-1 for an n x n lower triangle L and a row-major rows x n X: a
+// forward substitution along each row of X, one block of columns at a time,
+// with a gemm taking every solved block off the columns after it
+template <typename T>
+void trsm_right(int rows, int n, const T* l, std::ptrdiff_t ldl, T* x, std::ptrdiff_t ldx) {
+	for (int s = 0; s < n; s += tri_block) {
+		int w = std::min(tri_block, n - s), rest = n - s - w;
+		const T *l_ss = l + s*ldl + s;
+
+		for (int r = 0; r < rows; ++r) {
+			T *x_r = x + r*ldx + s;
+			for (int j = 0; j < w; ++j) {
+				const T *l_j = l_ss + j*ldl;
+				T v = x_r[j];
+				for (int p = 0; p < j; ++p)
+					v -= x_r[p] * l_j[p];
+				x_r[j] = v / l_j[j];
+			}
+		}
+		if (rest == 0)
+			break;
+
+		safe_gemm::gemm(rows, rest, w, T(-1), x + s, ldx, 1, l_ss + w*ldl, 1, ldl,
+		                T(1), x + s + w, ldx);
+	}
+}
+
+// the columns of B are independent, so they are shared out in strips of at
+// least 64
+template <typename T>
+void trsm(thread_pool& pool, bool lower, bool unit, int n, int nrhs,
+          const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa, T* b, std::ptrdiff_t ldb)
+{
+	if (pool.size() <= 1 || static_cast<long long>(n) * n * nrhs < safe_gemm::parallel_min) {
+		trsm(lower, unit, n, nrhs, a, rsa, csa, b, ldb);
+		return;
+	}
+
+	pool.parallel_range(nrhs, 64, [&](int lo, int hi) {
+		trsm(lower, unit, n, hi - lo, a, rsa, csa, b + lo, ldb);
+	});
+}
+
+// LU with partial pivoting of the m x n panel at a, m >= n, by halving the
+// columns (Toledo, 1997): the left half is factored, the right half updated
+// with a trsm and a gemm, then factored in turn. piv[j] is the panel row
+// swapped with row j. the swap moves the whole row, which starts at row and
+// is cols long, so columns left and right of the panel follow it. returns
+// false if a pivot was exactly zero
+template <typename T>
+bool getrf_panel(thread_pool& pool, int m, int n, T* a, std::ptrdiff_t ld,
+                 T* row, int cols, int* piv)
+{
+	using std::abs;
+
+	if (n == 1) {
+		int p = 0;
+		for (int i = 1; i < m; ++i)
+			if (abs(a[i*ld]) > abs(a[p*ld]))
+				p = i;
+
+		piv[0] = p;
+		if (p != 0)
+			std::swap_ranges(row, row + cols, row + p*ld);
+		if (a[0] == T(0))
+			return false;
+
+		for (int i = 1; i < m; ++i)
+			a[i*ld] /= a[0];
+		return true;
+	}
+
+	int n1 = n / 2, n2 = n - n1;
+	bool left = getrf_panel(pool, m, n1, a, ld, row, cols, piv);
+
+	trsm(pool, true, true, n1, n2, a, ld, 1, a + n1, ld);
+	safe_gemm::gemm(pool, m - n1, n2, n1, T(-1), a + n1*ld, ld, 1, a + n1, ld, 1,
+	                T(1), a + n1*ld + n1, ld);
+
+	bool right = getrf_panel(pool, m - n1, n2, a + n1*ld + n1, ld, row + n1*ld, cols, piv + n1);
+	for (int j = n1; j < n; ++j)
+		piv[j] += n1;
+
+	return left && right;
+}
+
+// right-looking blocked LU of the n x n matrix at a: factor a panel, solve
+// for the block row of U beside it, and take their product off the trailing
+// matrix. piv[j] is the row swapped with row j
+template <typename T>
+bool getrf(thread_pool& pool, int n, T* a, std::ptrdiff_t ld, int* piv) {
+	bool ok = true;
+
+	for (int k = 0; k < n; k += block) {
+		int nb = std::min(block, n - k), rest = n - k - nb;
+		T *a11 = a + k*ld + k, *a12 = a11 + nb, *a21 = a11 + nb*ld, *a22 = a21 + nb;
+
+		if (!getrf_panel(pool, n - k, nb, a11, ld, a + k*ld, n, piv + k))
+			ok = false;
+		for (int j = k; j < k + nb; ++j)
+			piv[j] += k;
+		if (rest == 0)
+			break;
+
+		trsm(pool, true, true, nb, rest, a11, ld, 1, a12, ld);
+		safe_gemm::gemm(pool, rest, rest, nb, T(-1), a21, ld, 1, a12, ld, 1, T(1), a22, ld);
+	}
+
+	return ok;
+}
+
+// unblocked Cholesky-Crout on a diagonal block; only the lower triangle is
+// read or written. false if the block is not positive definite
+template <typename T>
+bool potrf_block(int n, T* a, std::ptrdiff_t ld) {
+	using std::sqrt;
+
+	for (int j = 0; j < n; ++j) {
+		T *a_j = a + j*ld;
+		T d = a_j[j];
+		for (int p = 0; p < j; ++p)
+			d -= a_j[p] * a_j[p];
+		if (!(d > T(0)))
+			return false;
+
+		d = sqrt(d);
+		a_j[j] = d;
+		for (int i = j+1; i < n; ++i) {
+			T *a_i = a + i*ld;
+			T s = a_i[j];
+			for (int p = 0; p < j; ++p)
+				s -= a_i[p] * a_j[p];
+			a_i[j] = s / d;
+		}
+	}
+
+	return true;
+}
+
+// right-looking blocked Cholesky, A = L L', of a symmetric positive definite
+// n x n matrix at a; the lower triangle is read and overwritten with L. the
+// trailing update is split into block columns so only the lower triangle
+// of L21 L21' is formed
+template <typename T>
+bool potrf(thread_pool& pool, int n, T* a, std::ptrdiff_t ld) {
+	for (int k = 0; k < n; k += block) {
+		int nb = std::min(block, n - k), rest = n - k - nb;
+		T *a11 = a + k*ld + k, *a21 = a11 + nb*ld, *a22 = a21 + nb;
+
+		if (!potrf_block(nb, a11, ld))
+			return false;
+		if (rest == 0)
+			break;
+
+		// L21 = A21 L11'^-1; the rows are independent
+		int grain = std::max(64, safe_matrix_parallel_min / (nb * nb));
+		pool.parallel_range(rest, grain, [=](int lo, int hi) {
+			trsm_right(hi - lo, nb, a11, ld, a21 + lo*ld, ld);
+		});
+
+		int strips = (rest + block-1) / block;
+		pool.parallel_for(strips, [=](int t) {
+			int j = t * block, w = std::min(block, rest - j);
+			safe_gemm::gemm(rest - j, w, nb, T(-1), a21 + j*ld, ld, 1, a21 + j*ld, 1, ld,
+			                T(1), a22 + j*ld + j, ld);
+		});
+	}
+
+	return true;
+}
+
+// rows of the row-major b in the order the factorization swapped them
+template <typename T>
+void permute(const int* piv, int n, T* b, std::ptrdiff_t ldb, int nrhs) {
+	for (int i = 0; i < n; ++i)
+		if (piv[i] != i)
+			std::swap_ranges(b + i*ldb, b + i*ldb + nrhs, b + piv[i]*ldb);
+}
+
+inline void check_square(int rows, int cols) {
+	if (rows != cols)
+		throw std::length_error
+		(
+			"matrix not square: " + std::to_string(rows) + " x " + std::to_string(cols)
+		);
+}
+
+// solves in place of b; a row-major b goes straight to trsm, any other
+// layout through a temporary
+template <typename T>
+void triangular(bool lower, bool unit, const matrix_view<const T>& a, matrix_view<T> b) {
+	check_square(a.rows(), a.cols());
+	if (b.rows() != a.rows())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	if (b.col_stride() != 1) {
+		safe_matrix<T> x(b);
+		triangular(lower, unit, a, x.view());
+		b = x;
+		return;
+	}
+
+	trsm(thread_pool::shared(), lower, unit, a.rows(), b.cols(),
+	     a.data(), a.row_stride(), a.col_stride(), b.data(), b.row_stride());
+}
+
+}
+
+// P A = L U with partial pivoting, L unit lower and U upper, both stored in
+// one matrix. a singular matrix still factors; solving with it throws
+template <typename T>
+class lu_factorization {
+private:
+	safe_matrix<T> _lu;
+	safe_array<int> _piv;
+	bool _singular;
+
+	void decompose();
+	void solve_in_place(T*, std::ptrdiff_t, int) const;
+
+public:
+	typedef T value_type;
+
+	explicit lu_factorization(const safe_matrix<T>&);
+	explicit lu_factorization(safe_matrix<T>&&);
+
+	int size() const;
+	bool singular() const;
+	const safe_matrix<T>& factors() const;
+	const safe_array<int>& pivots() const;
+
+	T determinant() const;
+	safe_array<T> solve(const safe_array<T>&) const;
+	safe_matrix<T> solve(const safe_matrix<T>&) const;
+	safe_matrix<T> inverse() const;
+};
+
+template <typename T>
+lu_factorization<T>::lu_factorization(const safe_matrix<T>& sm) :
+_lu(sm), _singular(false)
+{
+	decompose();
+}
+
+template <typename T>
+lu_factorization<T>::lu_factorization(safe_matrix<T>&& sm) :
+_lu( std::move(sm) ), _singular(false)
+{
+	decompose();
+}
+
+template <typename T>
+void lu_factorization<T>::decompose() {
+	safe_linalg::check_square(_lu.rows(), _lu.cols());
+
+	_piv = safe_array<int>(_lu.rows());
+	_singular = !safe_linalg::getrf(thread_pool::shared(), _lu.rows(), _lu.data(), _lu.stride(), _piv.data());
+}
+
+template <typename T>
+void lu_factorization<T>::solve_in_place(T* b, std::ptrdiff_t ldb, int nrhs) const {
+	if (_singular)
+		throw std::domain_error
+		(
+			"matrix is singular"
+		);
+
+	int n = size();
+	safe_linalg::permute(_piv.data(), n, b, ldb, nrhs);
+	safe_linalg::trsm(thread_pool::shared(), true, true, n, nrhs, _lu.data(), _lu.stride(), 1, b, ldb);
+	safe_linalg::trsm(thread_pool::shared(), false, false, n, nrhs, _lu.data(), _lu.stride(), 1, b, ldb);
+}
+
+template <typename T>
+inline int lu_factorization<T>::size() const {
+	return _lu.rows();
+}
+
+template <typename T>
+inline bool lu_factorization<T>::singular() const {
+	return _singular;
+}
+
+// L below the diagonal, U on and above it, in the bounds of the input
+template <typename T>
+inline const safe_matrix<T>& lu_factorization<T>::factors() const {
+	return _lu;
+}
+
+// 0-based: row i was swapped with row pivots()[i], in order
+template <typename T>
+inline const safe_array<int>& lu_factorization<T>::pivots() const {
+	return _piv;
+}
+
+template <typename T>
+T lu_factorization<T>::determinant() const {
+	if (_singular)
+		return T(0);
+
+	T det(1);
+	for (int i = 0, n = size(); i < n; ++i) {
+		det *= _lu.data()[i*_lu.stride() + i];
+		if (_piv[i] != i)
+			det = -det;
+	}
+
+	return det;
+}
+
+template <typename T>
+safe_array<T> lu_factorization<T>::solve(const safe_array<T>& b) const {
+	if (b.size() != size())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_array<T> x(b.size());
+	std::copy(b.data(), b.data() + b.size(), x.data());
+	solve_in_place(x.data(), 1, 1);
+
+	return x;
+}
+
+template <typename T>
+safe_matrix<T> lu_factorization<T>::solve(const safe_matrix<T>& b) const {
+	if (b.rows() != size())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_matrix<T> x(b.view());
+	solve_in_place(x.data(), x.stride(), x.cols());
+
+	return x;
+}
+
+template <typename T>
+safe_matrix<T> lu_factorization<T>::inverse() const {
+	int n = size();
+	safe_matrix<T> x(n, n);
+	for (int i = 0; i < n; ++i) {
+		std::fill(x.data() + i*x.stride(), x.data() + i*x.stride() + n, T(0));
+		x.data()[i*x.stride() + i] = T(1);
+	}
+
+	solve_in_place(x.data(), x.stride(), n);
+	return x;
+}
+
+// A = L L' for a real symmetric positive definite A; only its lower
+// triangle is read. throws std::domain_error when A is not positive definite
+template <typename T>
+class cholesky_factorization {
+private:
+	safe_matrix<T> _l;
+
+	void decompose();
+	void solve_in_place(T*, std::ptrdiff_t, int) const;
+
+public:
+	typedef T value_type;
+
+	explicit cholesky_factorization(const safe_matrix<T>&);
+	explicit cholesky_factorization(safe_matrix<T>&&);
+
+	int size() const;
+	const safe_matrix<T>& factor() const;
+
+	T determinant() const;
+	safe_array<T> solve(const safe_array<T>&) const;
+	safe_matrix<T> solve(const safe_matrix<T>&) const;
+	safe_matrix<T> inverse() const;
+};
+
+template <typename T>
+cholesky_factorization<T>::cholesky_factorization(const safe_matrix<T>& sm) :
+_l(sm)
+{
+	decompose();
+}
+
+template <typename T>
+cholesky_factorization<T>::cholesky_factorization(safe_matrix<T>&& sm) :
+_l( std::move(sm) )
+{
+	decompose();
+}
+
+template <typename T>
+void cholesky_factorization<T>::decompose() {
+	int n = _l.rows();
+	safe_linalg::check_square(n, _l.cols());
+
+	if (!safe_linalg::potrf(thread_pool::shared(), n, _l.data(), _l.stride()))
+		throw std::domain_error
+		(
+			"matrix is not positive definite"
+		);
+
+	for (int i = 0; i < n; ++i)
+		std::fill(_l.data() + i*_l.stride() + i+1, _l.data() + i*_l.stride() + n, T(0));
+}
+
+// L y = b, then L' x = y through the transposed strides of L
+template <typename T>
+void cholesky_factorization<T>::solve_in_place(T* b, std::ptrdiff_t ldb, int nrhs) const {
+	int n = size();
+	safe_linalg::trsm(thread_pool::shared(), true, false, n, nrhs, _l.data(), _l.stride(), 1, b, ldb);
+	safe_linalg::trsm(thread_pool::shared(), false, false, n, nrhs, _l.data(), 1, _l.stride(), b, ldb);
+}
+
+template <typename T>
+inline int cholesky_factorization<T>::size() const {
+	return _l.rows();
+}
+
+// lower triangular, zero above the diagonal, in the bounds of the input
+template <typename T>
+inline const safe_matrix<T>& cholesky_factorization<T>::factor() const {
+	return _l;
+}
+
+template <typename T>
+T cholesky_factorization<T>::determinant() const {
+	T det(1);
+	for (int i = 0, n = size(); i < n; ++i) {
+		const T d = _l.data()[i*_l.stride() + i];
+		det *= d * d;
+	}
+
+	return det;
+}
+
+template <typename T>
+safe_array<T> cholesky_factorization<T>::solve(const safe_array<T>& b) const {
+	if (b.size() != size())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_array<T> x(b.size());
+	std::copy(b.data(), b.data() + b.size(), x.data());
+	solve_in_place(x.data(), 1, 1);
+
+	return x;
+}
+
+template <typename T>
+safe_matrix<T> cholesky_factorization<T>::solve(const safe_matrix<T>& b) const {
+	if (b.rows() != size())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_matrix<T> x(b.view());
+	solve_in_place(x.data(), x.stride(), x.cols());
+
+	return x;
+}
+
+template <typename T>
+safe_matrix<T> cholesky_factorization<T>::inverse() const {
+	int n = size();
+	safe_matrix<T> x(n, n);
+	for (int i = 0; i < n; ++i) {
+		std::fill(x.data() + i*x.stride(), x.data() + i*x.stride() + n, T(0));
+		x.data()[i*x.stride() + i] = T(1);
+	}
+
+	solve_in_place(x.data(), x.stride(), n);
+	return x;
+}
+
+// x with A x = b, through a fresh LU of A
+template <typename T>
+safe_array<T> solve(const safe_matrix<T>& a, const safe_array<T>& b) {
+	return lu_factorization<T>(a).solve(b);
+}
+
+template <typename T>
+safe_matrix<T> solve(const safe_matrix<T>& a, const safe_matrix<T>& b) {
+	return lu_factorization<T>(a).solve(b);
+}
+
+template <typename T>
+T determinant(const safe_matrix<T>& a) {
+	return lu_factorization<T>(a).determinant();
+}
+
+template <typename T>
+safe_matrix<T> inverse(const safe_matrix<T>& a) {
+	return lu_factorization<T>(a).inverse();
+}
+
+// B = L^-1 B and B = U^-1 B in place, reading only the named triangle of the
+// square operand; with unit set its diagonal is taken to be all ones. the
+// triangle may be any matrix expression, a transposed view included
+template <typename E, typename T>
+void solve_lower(const matrix_expr<E>& l, matrix_view<T> b, bool unit = false) {
+	matrix_product_operand<E> a(l.self());
+	safe_linalg::triangular(true, unit, a.view(), b);
+}
+
+template <typename E, typename T>
+void solve_lower(const matrix_expr<E>& l, safe_matrix<T>& b, bool unit = false) {
+	solve_lower(l, b.view(), unit);
+}
+
+template <typename E, typename T>
+void solve_lower(const matrix_expr<E>& l, safe_array<T>& b, bool unit = false) {
+	solve_lower(l, matrix_view<T>(b.data(), 0, b.size()-1, 0, 0, 1, 1), unit);
+}
+
+template <typename E, typename T>
+void solve_upper(const matrix_expr<E>& u, matrix_view<T> b, bool unit = false) {
+	matrix_product_operand<E> a(u.self());
+	safe_linalg::triangular(false, unit, a.view(), b);
+}
+
+template <typename E, typename T>
+void solve_upper(const matrix_expr<E>& u, safe_matrix<T>& b, bool unit = false) {
+	solve_upper(u, b.view(), unit);
+}
+
+template <typename E, typename T>
+void solve_upper(const matrix_expr<E>& u, safe_array<T>& b, bool unit = false) {
+	solve_upper(u, matrix_view<T>(b.data(), 0, b.size()-1, 0, 0, 1, 1), unit);
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef MATRIX_EXPR
+#define MATRIX_EXPR
+
+#include <stdexcept>
+#include <cstddef>
+
+// a dimension only known at run time
+const int safe_matrix_dynamic = -1;
+
+// safe_matrix<T> sizes and bounds itself at run time; safe_matrix<T, R, C>
+// and safe_matrix<T, R, C, R0, C0> fix both in the type (fixed_matrix.h)
+template <typename T, int R = safe_matrix_dynamic, int C = safe_matrix_dynamic, int R0 = 0, int C0 = 0>
+class safe_matrix;
+
+// CRTP base of safe_matrix, matrix_view and the lazy nodes built from them. a node
+// provides value_type, rows(), cols() and coeff(i, j), which takes 0-based
+// offsets and does no bounds checking; a chain like A + B - C is evaluated
+// element by element straight into its destination
+template <typename E>
+struct matrix_expr {
+	const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// how a matrix is read inside an expression: its data pointer and stride by
+// value, so stores to the destination cannot be taken to alias them
+template <typename T>
+class matrix_leaf {
+private:
+	const T *_data;
+	std::ptrdiff_t _stride;
+	int _rows, _cols;
+
+public:
+	typedef T value_type;
+
+	template <int R, int C, int R0, int C0>
+	explicit matrix_leaf(const safe_matrix<T, R, C, R0, C0>& sm) :
+	_data(sm.data()), _stride(sm.stride()), _rows(sm.rows()), _cols(sm.cols())
+	{ }
+
+	int rows() const { return _rows; }
+	int cols() const { return _cols; }
+	const T* data() const { return _data; }
+	std::ptrdiff_t stride() const { return _stride; }
+	const T& coeff(int i, int j) const { return _data[i*_stride + j]; }
+};
+
+// nodes hold their operands by value, so an expression can outlive the
+// temporaries it was built from; only the matrices themselves must stay alive
+template <typename E>
+struct matrix_operand { typedef const E type; };
+
+template <typename T, int R, int C, int R0, int C0>
+struct matrix_operand< safe_matrix<T, R, C, R0, C0> > { typedef const matrix_leaf<T> type; };
+
+// the shape of an expression when the types alone fix it, 0 otherwise
+template <typename E>
+struct matrix_static_shape {
+	static const int rows = 0, cols = 0;
+};
+
+template <typename T, int R, int C, int R0, int C0>
+struct matrix_static_shape< safe_matrix<T, R, C, R0, C0> > {
+	static const int rows = R > 0 ? R : 0, cols = C > 0 ? C : 0;
+};
+
+struct matrix_plus {
+	template <typename T>
+	T operator()(const T& x, const T& y) const { return x + y; }
+};
+
+struct matrix_minus {
+	template <typename T>
+	T operator()(const T& x, const T& y) const { return x - y; }
+};
+
+struct matrix_assign {
+	template <typename T, typename U>
+	void operator()(T& x, const U& y) const { x = y; }
+};
+
+struct matrix_add_assign {
+	template <typename T, typename U>
+	void operator()(T& x, const U& y) const { x += y; }
+};
+
+struct matrix_sub_assign {
+	template <typename T, typename U>
+	void operator()(T& x, const U& y) const { x -= y; }
+};
+
+template <typename L, typename R, typename Op>
+class matrix_binary : public matrix_expr< matrix_binary<L, R, Op> > {
+private:
+	typename matrix_operand<L>::type _l;
+	typename matrix_operand<R>::type _r;
+
+public:
+	typedef typename L::value_type value_type;
+
+	static_assert(!matrix_static_shape<L>::rows || !matrix_static_shape<R>::rows
+		|| matrix_static_shape<L>::rows == matrix_static_shape<R>::rows, "matrix dimension mismatch");
+	static_assert(!matrix_static_shape<L>::cols || !matrix_static_shape<R>::cols
+		|| matrix_static_shape<L>::cols == matrix_static_shape<R>::cols, "matrix dimension mismatch");
+
+	matrix_binary(const L& l, const R& r) :
+	_l(l), _r(r)
+	{
+		if (l.rows() != r.rows() || l.cols() != r.cols())
+			throw std::length_error
+			(
+				"matrix dimension mismatch"
+			);
+	}
+
+	int rows() const { return _l.rows(); }
+	int cols() const { return _l.cols(); }
+	typename matrix_operand<L>::type& lhs() const { return _l; }
+	typename matrix_operand<R>::type& rhs() const { return _r; }
+	value_type coeff(int i, int j) const { return Op()(_l.coeff(i, j), _r.coeff(i, j)); }
+};
+
+// Left says which side the scalar was written on, for types where it matters
+template <typename E, bool Left>
+class matrix_scaled : public matrix_expr< matrix_scaled<E, Left> > {
+private:
+	typename matrix_operand<E>::type _e;
+	typename E::value_type _s;
+
+public:
+	typedef typename E::value_type value_type;
+
+	matrix_scaled(const E& e, const value_type& s) :
+	_e(e), _s(s)
+	{ }
+
+	int rows() const { return _e.rows(); }
+	int cols() const { return _e.cols(); }
+	typename matrix_operand<E>::type& expr() const { return _e; }
+	value_type coeff(int i, int j) const { return Left ? _s * _e.coeff(i, j) : _e.coeff(i, j) * _s; }
+};
+
+template <typename L, typename R, typename Op>
+struct matrix_static_shape< matrix_binary<L, R, Op> > {
+	static const int rows = matrix_static_shape<L>::rows ? matrix_static_shape<L>::rows : matrix_static_shape<R>::rows;
+	static const int cols = matrix_static_shape<L>::cols ? matrix_static_shape<L>::cols : matrix_static_shape<R>::cols;
+};
+
+template <typename E, bool Left>
+struct matrix_static_shape< matrix_scaled<E, Left> > : matrix_static_shape<E> { };
+
+template <typename L, typename R>
+matrix_binary<L, R, matrix_plus> operator+(const matrix_expr<L>& l, const matrix_expr<R>& r) {
+	return matrix_binary<L, R, matrix_plus>(l.self(), r.self());
+}
+
+template <typename L, typename R>
+matrix_binary<L, R, matrix_minus> operator-(const matrix_expr<L>& l, const matrix_expr<R>& r) {
+	return matrix_binary<L, R, matrix_minus>(l.self(), r.self());
+}
+
+template <typename E>
+matrix_scaled<E, true> operator*(const typename E::value_type& s, const matrix_expr<E>& e) {
+	return matrix_scaled<E, true>(e.self(), s);
+}
+
+template <typename E>
+matrix_scaled<E, false> operator*(const matrix_expr<E>& e, const typename E::value_type& s) {
+	return matrix_scaled<E, false>(e.self(), s);
+}
+
+#endif
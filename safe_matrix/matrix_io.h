@@ -0,0 +1,710 @@
+#ifndef SAFE_MATRIX_IO
+#define SAFE_MATRIX_IO
+
+#include <ostream>
+#include <istream>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include "safe_array.h"
+#include "safe_array_io.h"
+#include "matrix_expr.h"
+#include "matrix_view.h"
+#include "safe_matrix.h"
+
+// 64 bytes like safe_array_header, so the payload of a mapped file stays
+// 64-byte aligned. the payload is row-major with no padding
+struct safe_matrix_header {
+	char magic[8];
+	std::uint32_t version, order;
+	std::uint32_t type, elem_size;
+	std::int32_t r_lo, r_hi, c_lo, c_hi;
+	char reserved[24];
+};
+
+static_assert(sizeof(safe_matrix_header) == 64, "safe_matrix_header must be 64 bytes");
+
+const char safe_matrix_magic[8] = { 'S', 'A', 'F', 'E', 'M', 'A', 'T', '\0' };
+const std::uint32_t safe_matrix_version = 1;
+
+// edge of the square blocks out_of_core_product holds in memory
+const int safe_matrix_io_tile = 1024;
+
+template <typename T>
+safe_matrix_header safe_matrix_make_header(int i1, int i2, int j1, int j2) {
+	safe_matrix_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, safe_matrix_magic, sizeof(header.magic));
+
+	header.version = safe_matrix_version;
+	header.order = safe_array_order;
+	header.type = safe_array_type_tag<T>();
+	header.elem_size = sizeof(T);
+	header.r_lo = i1;
+	header.r_hi = i2;
+	header.c_lo = j1;
+	header.c_hi = j2;
+
+	return header;
+}
+
+// the number of elements in the payload
+template <typename T>
+std::size_t safe_matrix_check_header(const safe_matrix_header& header) {
+	if (std::memcmp(header.magic, safe_matrix_magic, sizeof(header.magic)) != 0)
+		throw std::domain_error
+		(
+			"not a safe_matrix file"
+		);
+
+	if (header.version != safe_matrix_version || header.order != safe_array_order)
+		throw std::domain_error
+		(
+			"unsupported safe_matrix version or byte order"
+		);
+
+	if (header.type != safe_array_type_tag<T>() || header.elem_size != sizeof(T))
+		throw std::domain_error
+		(
+			"element type mismatch: stored size " + std::to_string(header.elem_size)
+		);
+
+	long long row_size = static_cast<long long>(header.r_hi) - header.r_lo + 1;
+	long long col_size = static_cast<long long>(header.c_hi) - header.c_lo + 1;
+	if (row_size <= 0 || col_size <= 0)
+		throw std::length_error
+		(
+			"invalid bounds. row size: " + std::to_string(row_size)
+			+ ", column size: " + std::to_string(col_size)
+		);
+
+	return static_cast<std::size_t>(row_size) * static_cast<std::size_t>(col_size);
+}
+
+// one write per row, or one for the whole payload when the rows are adjacent
+template <typename T>
+void write_binary(std::ostream& out, const matrix_view<T>& mv) {
+	typedef typename matrix_view<T>::value_type value_type;
+	static_assert(std::is_trivially_copyable<value_type>::value, "binary I/O needs a trivially copyable type");
+
+	safe_matrix_header header = safe_matrix_make_header<value_type>(mv.row_lo(), mv.row_hi(), mv.col_lo(), mv.col_hi());
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	const int rows = mv.rows(), cols = mv.cols();
+	const std::ptrdiff_t rs = mv.row_stride(), cs = mv.col_stride();
+
+	if (cs == 1 && (rs == cols || rows == 1)) {
+		out.write(reinterpret_cast<const char*>(mv.data()), sizeof(value_type) * rows * cols);
+		return;
+	}
+
+	safe_array<value_type> row(cols);
+	for (int i = 0; i < rows && out; ++i) {
+		const value_type *src = mv.data() + i * rs;
+		if (cs != 1) {
+			for (int j = 0; j < cols; ++j)
+				row[j] = src[j * cs];
+			src = row.data();
+		}
+
+		out.write(reinterpret_cast<const char*>(src), sizeof(value_type) * cols);
+	}
+}
+
+template <typename T, int R, int C, int R0, int C0>
+void write_binary(std::ostream& out, const safe_matrix<T, R, C, R0, C0>& sm) {
+	write_binary(out, sm.view());
+}
+
+// sm is left untouched when the stream runs short
+template <typename T>
+void read_binary(std::istream& in, safe_matrix<T>& sm) {
+	static_assert(std::is_trivially_copyable<T>::value, "binary I/O needs a trivially copyable type");
+
+	safe_matrix_header header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return;
+
+	safe_matrix_check_header<T>(header);
+	safe_matrix<T> new_mat(header.r_lo, header.r_hi, header.c_lo, header.c_hi);
+	const int rows = new_mat.rows(), cols = new_mat.cols();
+
+	if (new_mat.stride() == cols) {
+		if (!in.read(reinterpret_cast<char*>(new_mat.data()), sizeof(T) * rows * cols))
+			return;
+	} else {
+		for (int i = 0; i < rows; ++i)
+			if (!in.read(reinterpret_cast<char*>(new_mat.data() + i * new_mat.stride()), sizeof(T) * cols))
+				return;
+	}
+
+	sm = std::move(new_mat);
+}
+
+// the stored bounds are ignored; the dimensions must match
+template <typename T, int R, int C, int R0, int C0>
+typename std::enable_if<(R > 0 && C > 0)>::type
+read_binary(std::istream& in, safe_matrix<T, R, C, R0, C0>& sm) {
+	static_assert(std::is_trivially_copyable<T>::value, "binary I/O needs a trivially copyable type");
+
+	safe_matrix_header header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return;
+
+	safe_matrix_check_header<T>(header);
+	if (header.r_hi - header.r_lo + 1 != R || header.c_hi - header.c_lo + 1 != C)
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_matrix<T, R, C, R0, C0> new_mat;
+	if (in.read(reinterpret_cast<char*>(new_mat.data()), sizeof(T) * R * C))
+		sm = new_mat;
+}
+
+// reads rectangular blocks of a matrix file through a seekable stream, so a
+// matrix larger than memory can be worked through a block at a time
+template <typename T>
+class matrix_file_reader {
+	static_assert(std::is_trivially_copyable<T>::value, "binary I/O needs a trivially copyable type");
+
+private:
+	std::istream *_in;
+	std::streamoff _base;
+	int _r_lo, _r_hi, _c_lo, _c_hi;
+
+public:
+	typedef T value_type;
+
+	explicit matrix_file_reader(std::istream&);
+
+	int row_lo() const;
+	int row_hi() const;
+	int col_lo() const;
+	int col_hi() const;
+	int rows() const;
+	int cols() const;
+
+	void read(int, int, int, int, matrix_view<T>);
+	safe_matrix<T> read(int, int, int, int);
+};
+
+template <typename T>
+matrix_file_reader<T>::matrix_file_reader(std::istream& in) :
+_in(&in), _base(0), _r_lo(0), _r_hi(-1), _c_lo(0), _c_hi(-1)
+{
+	safe_matrix_header header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		throw std::domain_error
+		(
+			"truncated safe_matrix file"
+		);
+
+	safe_matrix_check_header<T>(header);
+	_base = in.tellg();
+	_r_lo = header.r_lo;
+	_r_hi = header.r_hi;
+	_c_lo = header.c_lo;
+	_c_hi = header.c_hi;
+}
+
+template <typename T>
+inline int matrix_file_reader<T>::row_lo() const {
+	return _r_lo;
+}
+
+template <typename T>
+inline int matrix_file_reader<T>::row_hi() const {
+	return _r_hi;
+}
+
+template <typename T>
+inline int matrix_file_reader<T>::col_lo() const {
+	return _c_lo;
+}
+
+template <typename T>
+inline int matrix_file_reader<T>::col_hi() const {
+	return _c_hi;
+}
+
+template <typename T>
+inline int matrix_file_reader<T>::rows() const {
+	return _r_hi-_r_lo+1;
+}
+
+template <typename T>
+inline int matrix_file_reader<T>::cols() const {
+	return _c_hi-_c_lo+1;
+}
+
+// rows i1 .. i2 and columns j1 .. j2 of the file into dst, one seek and one
+// read per row
+template <typename T>
+void matrix_file_reader<T>::read(int i1, int i2, int j1, int j2, matrix_view<T> dst) {
+	if (!safe_array_in_range(i1, _r_lo, _r_hi) || !safe_array_in_range(i2, _r_lo, _r_hi))
+		safe_array_out_of_range("row", safe_array_in_range(i1, _r_lo, _r_hi) ? i2 : i1);
+	if (!safe_array_in_range(j1, _c_lo, _c_hi) || !safe_array_in_range(j2, _c_lo, _c_hi))
+		safe_array_out_of_range("column", safe_array_in_range(j1, _c_lo, _c_hi) ? j2 : j1);
+
+	const int row_size = i2-i1+1, col_size = j2-j1+1;
+	if (row_size != dst.rows() || col_size != dst.cols())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_array<T> row;
+	if (dst.col_stride() != 1)
+		row.resize(col_size);
+
+	for (int i = 0; i < row_size; ++i) {
+		T *out = dst.col_stride() == 1 ? dst.data() + i * dst.row_stride() : row.data();
+		std::streamoff at = _base + static_cast<std::streamoff>(sizeof(T))
+			* ( static_cast<std::streamoff>(i1-_r_lo+i) * cols() + (j1-_c_lo) );
+
+		if (!_in->seekg(at) || !_in->read(reinterpret_cast<char*>(out), sizeof(T) * col_size))
+			throw std::domain_error
+			(
+				"truncated safe_matrix file"
+			);
+
+		if (dst.col_stride() != 1)
+			for (int j = 0; j < col_size; ++j)
+				dst.data()[i * dst.row_stride() + j * dst.col_stride()] = row[j];
+	}
+}
+
+// the block keeps the file's indices
+template <typename T>
+safe_matrix<T> matrix_file_reader<T>::read(int i1, int i2, int j1, int j2) {
+	safe_matrix<T> r_sm(i1, i2, j1, j2);
+	read(i1, i2, j1, j2, r_sm.view());
+
+	return r_sm;
+}
+
+// writes a matrix file block by block through a seekable stream; blocks may
+// come in any order, and any element never written reads back as zero
+template <typename T>
+class matrix_file_writer {
+	static_assert(std::is_trivially_copyable<T>::value, "binary I/O needs a trivially copyable type");
+
+private:
+	std::ostream *_out;
+	std::streamoff _base;
+	int _r_lo, _r_hi, _c_lo, _c_hi;
+
+public:
+	typedef T value_type;
+
+	matrix_file_writer(std::ostream&, int, int, int, int);
+
+	int row_lo() const;
+	int row_hi() const;
+	int col_lo() const;
+	int col_hi() const;
+	int rows() const;
+	int cols() const;
+
+	void write(const matrix_view<const T>&);
+
+	template <int R, int C, int R0, int C0>
+	void write(const safe_matrix<T, R, C, R0, C0>&);
+};
+
+// the payload is zero-filled up front, a row at a time, since not every
+// stream can seek past its end
+template <typename T>
+matrix_file_writer<T>::matrix_file_writer(std::ostream& out, int i1, int i2, int j1, int j2) :
+_out(&out), _base(0), _r_lo(i1), _r_hi(i2), _c_lo(j1), _c_hi(j2)
+{
+	safe_matrix_header header = safe_matrix_make_header<T>(i1, i2, j1, j2);
+	safe_matrix_check_header<T>(header);
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	_base = out.tellp();
+
+	const std::string zero(sizeof(T) * cols(), '\0');
+	for (int i = 0; i < rows() && out; ++i)
+		out.write(zero.data(), zero.size());
+
+	if (!out || _base < 0)
+		throw std::domain_error
+		(
+			"cannot write safe_matrix file"
+		);
+}
+
+template <typename T>
+inline int matrix_file_writer<T>::row_lo() const {
+	return _r_lo;
+}
+
+template <typename T>
+inline int matrix_file_writer<T>::row_hi() const {
+	return _r_hi;
+}
+
+template <typename T>
+inline int matrix_file_writer<T>::col_lo() const {
+	return _c_lo;
+}
+
+template <typename T>
+inline int matrix_file_writer<T>::col_hi() const {
+	return _c_hi;
+}
+
+template <typename T>
+inline int matrix_file_writer<T>::rows() const {
+	return _r_hi-_r_lo+1;
+}
+
+template <typename T>
+inline int matrix_file_writer<T>::cols() const {
+	return _c_hi-_c_lo+1;
+}
+
+// the block lands at its own indices, which must lie inside the file's
+template <typename T>
+void matrix_file_writer<T>::write(const matrix_view<const T>& mv) {
+	if (!safe_array_in_range(mv.row_lo(), _r_lo, _r_hi) || !safe_array_in_range(mv.row_hi(), _r_lo, _r_hi))
+		safe_array_out_of_range("row", safe_array_in_range(mv.row_lo(), _r_lo, _r_hi) ? mv.row_hi() : mv.row_lo());
+	if (!safe_array_in_range(mv.col_lo(), _c_lo, _c_hi) || !safe_array_in_range(mv.col_hi(), _c_lo, _c_hi))
+		safe_array_out_of_range("column", safe_array_in_range(mv.col_lo(), _c_lo, _c_hi) ? mv.col_hi() : mv.col_lo());
+
+	const int row_size = mv.rows(), col_size = mv.cols();
+	safe_array<T> row;
+	if (mv.col_stride() != 1)
+		row.resize(col_size);
+
+	for (int i = 0; i < row_size; ++i) {
+		const T *src = mv.data() + i * mv.row_stride();
+		if (mv.col_stride() != 1) {
+			for (int j = 0; j < col_size; ++j)
+				row[j] = src[j * mv.col_stride()];
+			src = row.data();
+		}
+
+		std::streamoff at = _base + static_cast<std::streamoff>(sizeof(T))
+			* ( static_cast<std::streamoff>(mv.row_lo()-_r_lo+i) * cols() + (mv.col_lo()-_c_lo) );
+
+		if (!_out->seekp(at) || !_out->write(reinterpret_cast<const char*>(src), sizeof(T) * col_size))
+			throw std::domain_error
+			(
+				"cannot write safe_matrix file"
+			);
+	}
+}
+
+template <typename T>
+template <int R, int C, int R0, int C0>
+inline void matrix_file_writer<T>::write(const safe_matrix<T, R, C, R0, C0>& sm) {
+	write(sm.view());
+}
+
+// c = a b with only three tile x tile blocks in memory at a time. c is
+// 0-based like every dynamic product, and each block of it is accumulated
+// in full before it is written
+template <typename T>
+void out_of_core_product(matrix_file_reader<T>& a, matrix_file_reader<T>& b, std::ostream& out, int tile = safe_matrix_io_tile) {
+	if (a.cols() != b.rows())
+		throw std::length_error
+		(
+			"IMPOSSIBLE"
+		);
+
+	if (tile <= 0)
+		throw std::length_error
+		(
+			"invalid tile size: " + std::to_string(tile)
+		);
+
+	const int m = a.rows(), n = b.cols(), k = a.cols();
+	matrix_file_writer<T> c(out, 0, m-1, 0, n-1);
+
+	for (int i = 0; i < m; i += tile) {
+		const int i2 = std::min(i + tile, m) - 1;
+		for (int j = 0; j < n; j += tile) {
+			const int j2 = std::min(j + tile, n) - 1;
+			safe_matrix<T> c_blk(i, i2, j, j2);
+
+			for (int p = 0; p < k; p += tile) {
+				const int p2 = std::min(p + tile, k) - 1;
+				safe_matrix<T> a_blk = a.read(a.row_lo() + i, a.row_lo() + i2, a.col_lo() + p, a.col_lo() + p2);
+				safe_matrix<T> b_blk = b.read(b.row_lo() + p, b.row_lo() + p2, b.col_lo() + j, b.col_lo() + j2);
+
+				gemm(T(1), a_blk, b_blk, p == 0 ? T(0) : T(1), c_blk);
+			}
+
+			c.write(c_blk);
+		}
+	}
+}
+
+#ifdef SAFE_ARRAY_MMAP
+
+// a matrix file mapped in place, usable wherever a matrix_view is. const T
+// maps the file read-only; non-const T maps it copy-on-write, so writes stay
+// private to the process and never reach the file
+template <typename T>
+class mapped_matrix : public matrix_expr< mapped_matrix<T> > {
+	static_assert(std::is_trivially_copyable<T>::value, "mapped_matrix needs a trivially copyable type");
+
+private:
+	T *_data;
+	void *_map;
+	std::size_t _len;
+	int _r_lo, _r_hi, _c_lo, _c_hi;
+
+	void unmap();
+
+public:
+	typedef typename std::remove_const<T>::type value_type;
+	typedef matrix_view<T> view_type;
+
+	mapped_matrix();
+	explicit mapped_matrix(const std::string&);
+	mapped_matrix(const mapped_matrix&) = delete;
+	mapped_matrix(mapped_matrix&&);
+
+	int row_lo() const;
+	int row_hi() const;
+	int col_lo() const;
+	int col_hi() const;
+	int rows() const;
+	int cols() const;
+	int stride() const;
+	T* data() const;
+
+	view_type view() const;
+	view_type block(int, int, int, int) const;
+	view_type row(int) const;
+	view_type col(int) const;
+	view_type transposed() const;
+	operator view_type() const;
+
+	T& operator()(int, int) const;
+
+	mapped_matrix& operator=(const mapped_matrix&) = delete;
+	mapped_matrix& operator=(mapped_matrix&&);
+
+	~mapped_matrix();
+};
+
+// expressions and products read a mapped matrix through its view
+template <typename T>
+struct matrix_operand< mapped_matrix<T> > { typedef const matrix_view<T> type; };
+
+template <typename T>
+class matrix_product_operand< mapped_matrix<T> > {
+private:
+	matrix_view<const typename mapped_matrix<T>::value_type> _view;
+
+public:
+	explicit matrix_product_operand(const mapped_matrix<T>& mm) : _view(mm.view()) { }
+	matrix_view<const typename mapped_matrix<T>::value_type> view() const { return _view; }
+};
+
+template <typename T, typename U>
+bool safe_matrix_alias(const mapped_matrix<T>& x, const matrix_view<U>& out) {
+	return safe_matrix_alias(x.view(), out);
+}
+
+template <typename T>
+mapped_matrix<T>::mapped_matrix() :
+_data(nullptr), _map(nullptr), _len(0), _r_lo(0), _r_hi(-1), _c_lo(0), _c_hi(-1)
+{ }
+
+template <typename T>
+mapped_matrix<T>::mapped_matrix(const std::string& path) :
+_data(nullptr), _map(nullptr), _len(0), _r_lo(0), _r_hi(-1), _c_lo(0), _c_hi(-1)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::system_error(errno, std::generic_category(), "open " + path);
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0) {
+		int err = errno;
+		::close(fd);
+		throw std::system_error(err, std::generic_category(), "stat " + path);
+	}
+
+	_len = static_cast<std::size_t>(st.st_size);
+	if (_len < sizeof(safe_matrix_header)) {
+		::close(fd);
+		throw std::domain_error
+		(
+			"truncated safe_matrix file: " + path
+		);
+	}
+
+	int prot = std::is_const<T>::value ? PROT_READ : PROT_READ | PROT_WRITE;
+	void *map = ::mmap(nullptr, _len, prot, MAP_PRIVATE, fd, 0);
+	int err = errno;
+	::close(fd);
+
+	if (map == MAP_FAILED)
+		throw std::system_error(err, std::generic_category(), "mmap " + path);
+	_map = map;
+
+	try {
+		const safe_matrix_header& header = *static_cast<const safe_matrix_header*>(_map);
+		std::size_t size = safe_matrix_check_header<value_type>(header);
+
+		if (size > (_len - sizeof(header)) / sizeof(T))
+			throw std::domain_error
+			(
+				"truncated safe_matrix file: " + path
+			);
+
+		_data = reinterpret_cast<T*>( static_cast<char*>(_map) + sizeof(header) );
+		_r_lo = header.r_lo;
+		_r_hi = header.r_hi;
+		_c_lo = header.c_lo;
+		_c_hi = header.c_hi;
+	} catch (...) {
+		unmap();
+		throw;
+	}
+}
+
+template <typename T>
+mapped_matrix<T>::mapped_matrix(mapped_matrix&& mm) :
+_data(mm._data), _map(mm._map), _len(mm._len),
+_r_lo(mm._r_lo), _r_hi(mm._r_hi), _c_lo(mm._c_lo), _c_hi(mm._c_hi)
+{
+	mm._data = nullptr;
+	mm._map = nullptr;
+	mm._len = 0;
+	mm._r_lo = mm._c_lo = 0;
+	mm._r_hi = mm._c_hi = -1;
+}
+
+template <typename T>
+void mapped_matrix<T>::unmap() {
+	if (_map != nullptr)
+		::munmap(_map, _len);
+
+	_data = nullptr;
+	_map = nullptr;
+	_len = 0;
+	_r_lo = _c_lo = 0;
+	_r_hi = _c_hi = -1;
+}
+
+template <typename T>
+inline int mapped_matrix<T>::row_lo() const {
+	return _r_lo;
+}
+
+template <typename T>
+inline int mapped_matrix<T>::row_hi() const {
+	return _r_hi;
+}
+
+template <typename T>
+inline int mapped_matrix<T>::col_lo() const {
+	return _c_lo;
+}
+
+template <typename T>
+inline int mapped_matrix<T>::col_hi() const {
+	return _c_hi;
+}
+
+template <typename T>
+inline int mapped_matrix<T>::rows() const {
+	return _r_hi-_r_lo+1;
+}
+
+template <typename T>
+inline int mapped_matrix<T>::cols() const {
+	return _c_hi-_c_lo+1;
+}
+
+template <typename T>
+inline int mapped_matrix<T>::stride() const {
+	return cols();
+}
+
+template <typename T>
+inline T* mapped_matrix<T>::data() const {
+	return _data;
+}
+
+// throws on an empty mapped_matrix, like any view with no elements
+template <typename T>
+inline matrix_view<T> mapped_matrix<T>::view() const {
+	return view_type(_data, _r_lo, _r_hi, _c_lo, _c_hi, cols(), 1);
+}
+
+template <typename T>
+inline matrix_view<T> mapped_matrix<T>::block(int i1, int i2, int j1, int j2) const {
+	return view().block(i1, i2, j1, j2);
+}
+
+template <typename T>
+inline matrix_view<T> mapped_matrix<T>::row(int i) const {
+	return view().row(i);
+}
+
+template <typename T>
+inline matrix_view<T> mapped_matrix<T>::col(int j) const {
+	return view().col(j);
+}
+
+template <typename T>
+inline matrix_view<T> mapped_matrix<T>::transposed() const {
+	return view().transposed();
+}
+
+template <typename T>
+inline mapped_matrix<T>::operator matrix_view<T>() const {
+	return view();
+}
+
+template <typename T>
+inline T& mapped_matrix<T>::operator()(int i, int j) const {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, _r_lo, _r_hi)))
+		safe_array_out_of_range("row", i);
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(j, _c_lo, _c_hi)))
+		safe_array_out_of_range("column", j);
+
+	return _data[static_cast<std::ptrdiff_t>(i-_r_lo) * cols() + (j-_c_lo)];
+}
+
+template <typename T>
+mapped_matrix<T>& mapped_matrix<T>::operator=(mapped_matrix&& rhs) {
+	if (this != &rhs) {
+		unmap();
+		std::swap(_data, rhs._data);
+		std::swap(_map, rhs._map);
+		std::swap(_len, rhs._len);
+		std::swap(_r_lo, rhs._r_lo);
+		std::swap(_r_hi, rhs._r_hi);
+		std::swap(_c_lo, rhs._c_lo);
+		std::swap(_c_hi, rhs._c_hi);
+	}
+
+	return *this;
+}
+
+template <typename T>
+mapped_matrix<T>::~mapped_matrix() {
+	unmap();
+}
+
+#endif
+
+#endif
@@ -0,0 +1,583 @@
+#ifndef SAFE_SPARSE
+#define SAFE_SPARSE
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <climits>
+#include <cstddef>
+#include "safe_matrix.h"
+
+// compressed sparse storage: csr_matrix keeps each row's nonzeros together,
+// csc_matrix each column's. both are compressed_matrix, which stores the
+// "outer" lines (rows for CSR, columns for CSC) as an offset array plus the
+// 0-based inner index and value of every nonzero, sorted within each line.
+// memory is O(nnz + outer) and every operation below is O(nnz) or O(flops)
+template <typename T, bool Rows>
+class compressed_matrix;
+
+template <typename T>
+using csr_matrix = compressed_matrix<T, true>;
+
+template <typename T>
+using csc_matrix = compressed_matrix<T, false>;
+
+template <typename T>
+struct sparse_entry {
+	int row, col;
+	T value;
+};
+
+namespace safe_sparse {
+
+// work below this many nonzeros or multiply-adds stays on the calling thread
+const long long parallel_min = 1 << 15;
+
+template <typename T>
+safe_array<T> sized(int n) {
+	safe_array<T> arr;
+	arr.resize(n);
+	return arr;
+}
+
+inline int checked_nnz(long long nnz) {
+	if (nnz > INT_MAX)
+		throw std::length_error
+		(
+			"too many nonzeros: " + std::to_string(nnz)
+		);
+	return static_cast<int>(nnz);
+}
+
+// [0, outer) cut into parts of about equal weight, where weight[i] is the
+// running total up to line i; bounds get parts+1 entries
+inline std::vector<int> balanced(const int* weight, int outer, int parts) {
+	std::vector<int> bounds(parts + 1, outer);
+	long long total = weight[outer];
+	bounds[0] = 0;
+	for (int p = 1; p < parts; ++p)
+		bounds[p] = static_cast<int>(std::lower_bound(weight, weight + outer,
+			static_cast<int>(total * p / parts)) - weight);
+	return bounds;
+}
+
+// transposes the compressed structure: outer lines become inner and back.
+// a counting sort, so each output line comes out sorted
+template <typename T>
+void transpose(int outer, int inner, const int* ptr, const int* idx, const T* val,
+               int* t_ptr, int* t_idx, T* t_val)
+{
+	std::fill(t_ptr, t_ptr + inner + 1, 0);
+	for (int k = 0; k < ptr[outer]; ++k)
+		++t_ptr[idx[k] + 1];
+	for (int j = 0; j < inner; ++j)
+		t_ptr[j+1] += t_ptr[j];
+
+	std::vector<int> next(t_ptr, t_ptr + inner);
+	for (int i = 0; i < outer; ++i)
+		for (int k = ptr[i]; k < ptr[i+1]; ++k) {
+			int at = next[idx[k]]++;
+			t_idx[at] = i;
+			t_val[at] = val[k];
+		}
+}
+
+// y = A x over the outer lines, split so each task gets about the same nonzeros
+template <typename T>
+void spmv_outer(thread_pool& pool, int outer, const int* ptr, const int* idx, const T* val,
+                const T* x, T* y)
+{
+	auto rows = [=](int lo, int hi) {
+		for (int i = lo; i < hi; ++i) {
+			T sum = 0;
+			for (int k = ptr[i]; k < ptr[i+1]; ++k)
+				sum += val[k] * x[idx[k]];
+			y[i] = sum;
+		}
+	};
+
+	if (pool.size() <= 1 || ptr[outer] + outer < parallel_min) {
+		rows(0, outer);
+		return;
+	}
+
+	int parts = 4 * pool.size();
+	std::vector<int> bounds = balanced(ptr, outer, parts);
+	pool.parallel_for(parts, [&](int p) { rows(bounds[p], bounds[p+1]); });
+}
+
+// y = A x when the outer lines are columns: each task scatters its columns
+// into a private y, and the partial results are summed row by row
+template <typename T>
+void spmv_inner(thread_pool& pool, int outer, int inner, const int* ptr, const int* idx,
+                const T* val, const T* x, T* y)
+{
+	auto scatter = [=](int lo, int hi, T* out) {
+		for (int j = lo; j < hi; ++j)
+			for (int k = ptr[j]; k < ptr[j+1]; ++k)
+				out[idx[k]] += val[k] * x[j];
+	};
+
+	std::fill(y, y + inner, T(0));
+	if (pool.size() <= 1 || ptr[outer] + outer < parallel_min) {
+		scatter(0, outer, y);
+		return;
+	}
+
+	int parts = pool.size();
+	std::vector<int> bounds = balanced(ptr, outer, parts);
+	std::vector< safe_array<T> > partial(parts - 1);
+
+	pool.parallel_for(parts, [&](int p) {
+		T *out = y;
+		if (p > 0) {
+			partial[p-1] = sized<T>(inner);
+			out = partial[p-1].data();
+			std::fill(out, out + inner, T(0));
+		}
+		scatter(bounds[p], bounds[p+1], out);
+	});
+
+	pool.parallel_range(inner, parallel_min, [&](int lo, int hi) {
+		for (int p = 0; p < parts - 1; ++p) {
+			const T *part = partial[p].data();
+			for (int i = lo; i < hi; ++i)
+				y[i] += part[i];
+		}
+	});
+}
+
+// Gustavson's row-by-row product over outer lines: line i of C is the sum of
+// b's lines k scaled by a(i, k). a dense accumulator of width inner and a
+// marker per task keep each line O(its flops). Swap multiplies b * a instead,
+// which is the order the CSC form needs.
+template <typename T, bool Swap>
+void spgemm(thread_pool& pool, int outer, int inner,
+            const int* a_ptr, const int* a_idx, const T* a_val,
+            const int* b_ptr, const int* b_idx, const T* b_val,
+            safe_array<int>& c_ptr, safe_array<int>& c_idx, safe_array<T>& c_val)
+{
+	// multiply-adds per line, as running totals, to balance the tasks
+	std::vector<long long> flops(outer + 1, 0);
+	for (int i = 0; i < outer; ++i) {
+		long long f = 0;
+		for (int k = a_ptr[i]; k < a_ptr[i+1]; ++k)
+			f += b_ptr[a_idx[k]+1] - b_ptr[a_idx[k]];
+		flops[i+1] = flops[i] + f;
+	}
+
+	int parts = pool.size() <= 1 || flops[outer] < parallel_min ? 1 : pool.size();
+	std::vector<int> bounds(parts + 1, outer);
+	bounds[0] = 0;
+	for (int p = 1; p < parts; ++p)
+		bounds[p] = static_cast<int>(std::lower_bound(flops.begin(), flops.end(),
+			flops[outer] * p / parts) - flops.begin());
+
+	c_ptr = sized<int>(outer + 1);
+	int *cp = c_ptr.data();
+	cp[0] = 0;
+
+	// symbolic pass: the length of every line of C
+	pool.parallel_for(parts, [&](int p) {
+		std::vector<int> mark(inner, -1);
+		for (int i = bounds[p]; i < bounds[p+1]; ++i) {
+			int count = 0;
+			for (int k = a_ptr[i]; k < a_ptr[i+1]; ++k)
+				for (int l = b_ptr[a_idx[k]]; l < b_ptr[a_idx[k]+1]; ++l)
+					if (mark[b_idx[l]] != i) {
+						mark[b_idx[l]] = i;
+						++count;
+					}
+			cp[i+1] = count;
+		}
+	});
+
+	long long nnz = 0;
+	for (int i = 0; i < outer; ++i) {
+		nnz += cp[i+1];
+		cp[i+1] = checked_nnz(nnz);
+	}
+
+	c_idx = sized<int>(cp[outer]);
+	c_val = sized<T>(cp[outer]);
+	int *ci = c_idx.data();
+	T *cv = c_val.data();
+
+	// numeric pass: accumulate densely, then emit the line in index order
+	pool.parallel_for(parts, [&](int p) {
+		std::vector<int> mark(inner, -1);
+		std::vector<T> acc(inner);
+		for (int i = bounds[p]; i < bounds[p+1]; ++i) {
+			int *line = ci + cp[i], len = 0;
+			for (int k = a_ptr[i]; k < a_ptr[i+1]; ++k) {
+				const T& a_ik = a_val[k];
+				for (int l = b_ptr[a_idx[k]]; l < b_ptr[a_idx[k]+1]; ++l) {
+					int j = b_idx[l];
+					T prod = Swap ? b_val[l] * a_ik : a_ik * b_val[l];
+					if (mark[j] != i) {
+						mark[j] = i;
+						acc[j] = prod;
+						line[len++] = j;
+					} else {
+						acc[j] += prod;
+					}
+				}
+			}
+
+			std::sort(line, line + len);
+			for (int l = 0; l < len; ++l)
+				cv[cp[i] + l] = acc[line[l]];
+		}
+	});
+}
+
+}
+
+template <typename T, bool Rows>
+class compressed_matrix {
+private:
+	int _r_lo, _r_hi, _c_lo, _c_hi;
+	safe_array<int> _ptr, _idx;
+	safe_array<T> _val;
+
+	int outer() const;
+	int inner() const;
+	void check_bounds() const;
+
+	template <typename U, bool R>
+	friend class compressed_matrix;
+
+	template <typename U, bool R>
+	friend compressed_matrix<U, R> operator*(const compressed_matrix<U, R>&, const compressed_matrix<U, R>&);
+
+public:
+	typedef T value_type;
+
+	compressed_matrix(int, int);
+	compressed_matrix(int, int, int, int);
+	compressed_matrix(int, int, int, int, const std::vector< sparse_entry<T> >&);
+	explicit compressed_matrix(const safe_matrix<T>&);
+	explicit compressed_matrix(const compressed_matrix<T, !Rows>&);
+
+	int row_lo() const;
+	int row_hi() const;
+	int col_lo() const;
+	int col_hi() const;
+	int rows() const;
+	int cols() const;
+	int nnz() const;
+
+	const int* outer_ptr() const;
+	const int* inner_index() const;
+	const T* values() const;
+
+	T operator()(int, int) const;
+	safe_matrix<T> to_dense() const;
+};
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::outer() const {
+	return Rows ? rows() : cols();
+}
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::inner() const {
+	return Rows ? cols() : rows();
+}
+
+template <typename T, bool Rows>
+void compressed_matrix<T, Rows>::check_bounds() const {
+	int row_size = _r_hi-_r_lo+1, col_size = _c_hi-_c_lo+1;
+	if (row_size <= 0 || col_size <= 0)
+		throw std::length_error
+		(
+			"invalid bounds. row size: " + std::to_string(row_size)
+			+ ", column size: " + std::to_string(col_size)
+		);
+}
+
+template <typename T, bool Rows>
+compressed_matrix<T, Rows>::compressed_matrix(int rows, int cols) :
+compressed_matrix(0, rows-1, 0, cols-1)
+{ }
+
+// all zeros
+template <typename T, bool Rows>
+compressed_matrix<T, Rows>::compressed_matrix(int i1, int i2, int j1, int j2) :
+_r_lo(i1), _r_hi(i2), _c_lo(j1), _c_hi(j2)
+{
+	check_bounds();
+	_ptr = safe_sparse::sized<int>(outer() + 1);
+	std::fill(_ptr.data(), _ptr.data() + outer() + 1, 0);
+}
+
+// from (row, column, value) triplets in the given bounds; duplicates are summed
+template <typename T, bool Rows>
+compressed_matrix<T, Rows>::compressed_matrix(int i1, int i2, int j1, int j2,
+                                              const std::vector< sparse_entry<T> >& entries) :
+compressed_matrix(i1, i2, j1, j2)
+{
+	int n = safe_sparse::checked_nnz(entries.size());
+	for (const sparse_entry<T>& e: entries) {
+		if (!safe_array_in_range(e.row, _r_lo, _r_hi))
+			safe_array_out_of_range("row", e.row);
+		if (!safe_array_in_range(e.col, _c_lo, _c_hi))
+			safe_array_out_of_range("column", e.col);
+	}
+
+	// bucket by inner line first, then by outer, so each outer line comes out sorted
+	safe_array<int> by_inner = safe_sparse::sized<int>(n), by_outer = safe_sparse::sized<int>(n);
+	std::vector<int> count(std::max(outer(), inner()) + 1);
+	auto out_of = [&](int k) { return Rows ? entries[k].row - _r_lo : entries[k].col - _c_lo; };
+	auto in_of = [&](int k) { return Rows ? entries[k].col - _c_lo : entries[k].row - _r_lo; };
+
+	std::fill(count.begin(), count.end(), 0);
+	for (int k = 0; k < n; ++k) ++count[in_of(k) + 1];
+	for (int j = 0; j < inner(); ++j) count[j+1] += count[j];
+	for (int k = 0; k < n; ++k) by_inner[count[in_of(k)]++] = k;
+
+	std::fill(count.begin(), count.end(), 0);
+	for (int k = 0; k < n; ++k) ++count[out_of(k) + 1];
+	for (int i = 0; i < outer(); ++i) count[i+1] += count[i];
+	for (int k = 0; k < n; ++k) {
+		int e = by_inner[k];
+		by_outer[count[out_of(e)]++] = e;
+	}
+
+	_idx = safe_sparse::sized<int>(n);
+	_val = safe_sparse::sized<T>(n);
+	int len = 0;
+
+	for (int k = 0, i = 0; k < n; ++k) {
+		int e = by_outer[k];
+		while (i < out_of(e)) _ptr[++i] = len;
+
+		if (len > _ptr[i] && _idx[len-1] == in_of(e)) {
+			_val[len-1] += entries[e].value;
+		} else {
+			_idx[len] = in_of(e);
+			_val[len] = entries[e].value;
+			++len;
+		}
+	}
+	for (int i = n ? out_of(by_outer[n-1]) : 0; i < outer(); ++i)
+		_ptr[i+1] = len;
+
+	_idx.resize(len);
+	_val.resize(len);
+}
+
+// keeps the dense bounds and drops the entries equal to T(0)
+template <typename T, bool Rows>
+compressed_matrix<T, Rows>::compressed_matrix(const safe_matrix<T>& sm) :
+compressed_matrix(sm.row_lo(), sm.row_hi(), sm.col_lo(), sm.col_hi())
+{
+	const T *data = sm.data();
+	std::ptrdiff_t stride = sm.stride();
+	auto at = [&](int i, int j) -> const T& {
+		return Rows ? data[i*stride + j] : data[j*stride + i];
+	};
+
+	long long nnz = 0;
+	for (int i = 0; i < outer(); ++i) {
+		for (int j = 0; j < inner(); ++j)
+			if (at(i, j) != T(0)) ++nnz;
+		_ptr[i+1] = safe_sparse::checked_nnz(nnz);
+	}
+
+	_idx = safe_sparse::sized<int>(_ptr[outer()]);
+	_val = safe_sparse::sized<T>(_ptr[outer()]);
+	for (int i = 0, k = 0; i < outer(); ++i)
+		for (int j = 0; j < inner(); ++j)
+			if (at(i, j) != T(0)) {
+				_idx[k] = j;
+				_val[k++] = at(i, j);
+			}
+}
+
+// CSR from CSC and back, in O(nnz + rows + cols)
+template <typename T, bool Rows>
+compressed_matrix<T, Rows>::compressed_matrix(const compressed_matrix<T, !Rows>& other) :
+compressed_matrix(other._r_lo, other._r_hi, other._c_lo, other._c_hi)
+{
+	int nnz = other.nnz();
+	_idx = safe_sparse::sized<int>(nnz);
+	_val = safe_sparse::sized<T>(nnz);
+	safe_sparse::transpose(other.outer(), other.inner(), other._ptr.data(), other._idx.data(),
+	                       other._val.data(), _ptr.data(), _idx.data(), _val.data());
+}
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::row_lo() const {
+	return _r_lo;
+}
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::row_hi() const {
+	return _r_hi;
+}
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::col_lo() const {
+	return _c_lo;
+}
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::col_hi() const {
+	return _c_hi;
+}
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::rows() const {
+	return _r_hi-_r_lo+1;
+}
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::cols() const {
+	return _c_hi-_c_lo+1;
+}
+
+template <typename T, bool Rows>
+inline int compressed_matrix<T, Rows>::nnz() const {
+	return _ptr[outer()];
+}
+
+template <typename T, bool Rows>
+inline const int* compressed_matrix<T, Rows>::outer_ptr() const {
+	return _ptr.data();
+}
+
+template <typename T, bool Rows>
+inline const int* compressed_matrix<T, Rows>::inner_index() const {
+	return _idx.data();
+}
+
+template <typename T, bool Rows>
+inline const T* compressed_matrix<T, Rows>::values() const {
+	return _val.data();
+}
+
+// bounds-checked like safe_matrix; entries that are not stored read as T(0)
+template <typename T, bool Rows>
+T compressed_matrix<T, Rows>::operator()(int i, int j) const {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, _r_lo, _r_hi)))
+		safe_array_out_of_range("row", i);
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(j, _c_lo, _c_hi)))
+		safe_array_out_of_range("column", j);
+
+	int o = Rows ? i-_r_lo : j-_c_lo, in = Rows ? j-_c_lo : i-_r_lo;
+	const int *first = _idx.data() + _ptr[o], *last = _idx.data() + _ptr[o+1];
+	const int *at = std::lower_bound(first, last, in);
+
+	return at != last && *at == in ? _val[static_cast<int>(at - _idx.data())] : T(0);
+}
+
+template <typename T, bool Rows>
+safe_matrix<T> compressed_matrix<T, Rows>::to_dense() const {
+	safe_matrix<T> r_sm(_r_lo, _r_hi, _c_lo, _c_hi);
+	T *data = r_sm.data();
+	std::ptrdiff_t stride = r_sm.stride();
+
+	for (int i = 0; i < rows(); ++i)
+		std::fill(data + i*stride, data + i*stride + cols(), T(0));
+
+	for (int o = 0; o < outer(); ++o)
+		for (int k = _ptr[o]; k < _ptr[o+1]; ++k) {
+			int i = Rows ? o : _idx[k], j = Rows ? _idx[k] : o;
+			data[i*stride + j] = _val[k];
+		}
+
+	return r_sm;
+}
+
+// SpMV; like the dense product the result is 0-based and x is taken by position
+template <typename T, bool Rows>
+safe_array<T> operator*(const compressed_matrix<T, Rows>& sp, const safe_array<T>& sa) {
+	if (sp.cols() != sa.size())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_array<T> r_sa(sp.rows());
+	if (Rows)
+		safe_sparse::spmv_outer(thread_pool::shared(), sp.rows(), sp.outer_ptr(), sp.inner_index(),
+		                        sp.values(), sa.data(), r_sa.data());
+	else
+		safe_sparse::spmv_inner(thread_pool::shared(), sp.cols(), sp.rows(), sp.outer_ptr(),
+		                        sp.inner_index(), sp.values(), sa.data(), r_sa.data());
+
+	return r_sa;
+}
+
+// SpGEMM of two matrices in the same format; 0-based like the dense product.
+// for CSC, C^T = B^T A^T and the CSC arrays of B are the CSR arrays of B^T
+template <typename T, bool Rows>
+compressed_matrix<T, Rows> operator*(const compressed_matrix<T, Rows>& a, const compressed_matrix<T, Rows>& b) {
+	if (a.cols() != b.rows())
+		throw std::length_error
+		(
+			"IMPOSSIBLE"
+		);
+
+	compressed_matrix<T, Rows> r_sp(a.rows(), b.cols());
+	const compressed_matrix<T, Rows>& lhs = Rows ? a : b;
+	const compressed_matrix<T, Rows>& rhs = Rows ? b : a;
+
+	safe_sparse::spgemm<T, !Rows>(thread_pool::shared(), lhs.outer(), rhs.inner(),
+	                              lhs._ptr.data(), lhs._idx.data(), lhs._val.data(),
+	                              rhs._ptr.data(), rhs._idx.data(), rhs._val.data(),
+	                              r_sp._ptr, r_sp._idx, r_sp._val);
+
+	return r_sp;
+}
+
+// dense += sparse touches only the nonzeros
+template <typename T, bool Rows>
+safe_matrix<T>& operator+=(safe_matrix<T>& sm, const compressed_matrix<T, Rows>& sp) {
+	if (sm.rows() != sp.rows() || sm.cols() != sp.cols())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	const int *ptr = sp.outer_ptr(), *idx = sp.inner_index();
+	const T *val = sp.values();
+	T *data = sm.data();
+	std::ptrdiff_t stride = sm.stride();
+	int outer = Rows ? sp.rows() : sp.cols();
+
+	for (int o = 0; o < outer; ++o)
+		for (int k = ptr[o]; k < ptr[o+1]; ++k) {
+			int i = Rows ? o : idx[k], j = Rows ? idx[k] : o;
+			data[i*stride + j] += val[k];
+		}
+
+	return sm;
+}
+
+// sparse + dense gives a dense, 0-based result
+template <typename T, bool Rows>
+safe_matrix<T> operator+(const compressed_matrix<T, Rows>& sp, const safe_matrix<T>& sm) {
+	if (sm.rows() != sp.rows() || sm.cols() != sp.cols())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_matrix<T> r_sm(sm.rows(), sm.cols());
+	for (int i = 0; i < sm.rows(); ++i)
+		std::copy(sm.data() + i*sm.stride(), sm.data() + i*sm.stride() + sm.cols(),
+		          r_sm.data() + i*r_sm.stride());
+
+	r_sm += sp;
+	return r_sm;
+}
+
+template <typename T, bool Rows>
+safe_matrix<T> operator+(const safe_matrix<T>& sm, const compressed_matrix<T, Rows>& sp) {
+	return sp + sm;
+}
+
+#endif
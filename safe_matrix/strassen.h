@@ -0,0 +1,194 @@
+#ifndef SAFE_STRASSEN
+#define SAFE_STRASSEN
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+#include <climits>
+#include "safe_matrix.h"
+
+// Winograd's variant of Strassen's algorithm: 7 half-size products and 15
+// additions per level instead of 8 products. the recursion halves m, k and n
+// until one of them reaches the cutoff and hands the rest to the blocked gemm.
+// odd sizes are peeled: the even core recurses and the leftover row, column
+// and rank-1 term are fixed up with gemm.
+//
+// accuracy (Higham, Accuracy and Stability of Numerical Algorithms, 2nd ed.,
+// thm 23.3): for n x n operands recursing down to n0, with unit roundoff u,
+//
+//     max|C - fl(C)| <= [ (n/n0)^log2(18) * (n0^2 + 6*n0) - 6n ] * u * max|A| * max|B|
+//
+// to first order. the conventional product satisfies the componentwise
+// |C - fl(C)| <= n * u * |A||B|, so Winograd is only normwise stable and can
+// lose relative accuracy in small entries of C when A or B is badly scaled.
+// each level multiplies the constant by about 18/8. integer types are exact
+// as long as the intermediate sums do not overflow.
+namespace safe_strassen {
+
+// tuned against the AVX-512 gemm: one level breaks even at n = 2048 and two
+// levels save 10-15% at 4096. below this the extra additions and the smaller
+// base products cost more than the multiply they save
+const int cutoff = 1024;
+
+// c = op(a, b) element-wise; c may be a or b
+template <typename T, typename Op>
+void combine(thread_pool& pool, int m, int n, const T* a, std::ptrdiff_t lda,
+             const T* b, std::ptrdiff_t ldb, T* c, std::ptrdiff_t ldc, Op op)
+{
+	int grain = std::max(1, safe_matrix_parallel_min / n);
+
+	pool.parallel_range(m, grain, [=](int lo, int hi) {
+		for (int i = lo; i < hi; ++i) {
+			const T *x = a + i*lda, *y = b + i*ldb;
+			T *z = c + i*ldc;
+			for (int j = 0; j < n; ++j)
+				z[j] = op(x[j], y[j]);
+		}
+	});
+}
+
+inline bool base_case(int m, int k, int n, int cut) {
+	return m <= cut || k <= cut || n <= cut;
+}
+
+// elements of scratch the recursion needs below an m x k by k x n product
+inline long long workspace(int m, int k, int n, int cut) {
+	long long total = 0;
+	while (!base_case(m, k, n, cut)) {
+		m /= 2, k /= 2, n /= 2;
+		total += static_cast<long long>(m) * std::max(k, n) + static_cast<long long>(k) * n;
+	}
+	return total;
+}
+
+// C = A * B. each level uses an m/2 x max(k/2, n/2) block X and a k/2 x n/2
+// block Y from ws; the products land straight in the quadrants of C
+// (Douglas et al., 1994, adapted to the Winograd form)
+template <typename T>
+void multiply(thread_pool& pool, int m, int k, int n,
+              const T* a, std::ptrdiff_t lda, const T* b, std::ptrdiff_t ldb,
+              T* c, std::ptrdiff_t ldc, T* ws, int cut)
+{
+	if (base_case(m, k, n, cut)) {
+		safe_gemm::gemm(pool, m, n, k, T(1), a, lda, 1, b, ldb, 1, T(0), c, ldc);
+		return;
+	}
+
+	int m2 = m/2, k2 = k/2, n2 = n/2;
+	const T *a11 = a, *a12 = a + k2, *a21 = a + m2*lda, *a22 = a21 + k2;
+	const T *b11 = b, *b12 = b + n2, *b21 = b + k2*ldb, *b22 = b21 + n2;
+	T *c11 = c, *c12 = c + n2, *c21 = c + m2*ldc, *c22 = c21 + n2;
+
+	std::ptrdiff_t ldx = std::max(k2, n2), ldy = n2;
+	T *x = ws, *y = x + m2*ldx, *next = y + static_cast<std::ptrdiff_t>(k2) * n2;
+
+	combine(pool, m2, k2, a11, lda, a21, lda, x, ldx, matrix_minus());   // S3 = A11 - A21
+	combine(pool, k2, n2, b22, ldb, b12, ldb, y, ldy, matrix_minus());   // T3 = B22 - B12
+	multiply(pool, m2, k2, n2, x, ldx, y, ldy, c21, ldc, next, cut);     // P7 = S3 T3
+	combine(pool, m2, k2, a21, lda, a22, lda, x, ldx, matrix_plus());    // S1 = A21 + A22
+	combine(pool, k2, n2, b12, ldb, b11, ldb, y, ldy, matrix_minus());   // T1 = B12 - B11
+	multiply(pool, m2, k2, n2, x, ldx, y, ldy, c22, ldc, next, cut);     // P5 = S1 T1
+	combine(pool, m2, k2, x, ldx, a11, lda, x, ldx, matrix_minus());     // S2 = S1 - A11
+	combine(pool, k2, n2, b22, ldb, y, ldy, y, ldy, matrix_minus());     // T2 = B22 - T1
+	multiply(pool, m2, k2, n2, x, ldx, y, ldy, c12, ldc, next, cut);     // P6 = S2 T2
+	combine(pool, m2, k2, a12, lda, x, ldx, x, ldx, matrix_minus());     // S4 = A12 - S2
+	multiply(pool, m2, k2, n2, x, ldx, b22, ldb, c11, ldc, next, cut);   // P3 = S4 B22
+	multiply(pool, m2, k2, n2, a11, lda, b11, ldb, x, ldx, next, cut);   // P1 = A11 B11
+	combine(pool, m2, n2, x, ldx, c12, ldc, c12, ldc, matrix_plus());    // U2 = P1 + P6
+	combine(pool, m2, n2, c12, ldc, c21, ldc, c21, ldc, matrix_plus());  // U3 = U2 + P7
+	combine(pool, m2, n2, c12, ldc, c22, ldc, c12, ldc, matrix_plus());  // U4 = U2 + P5
+	combine(pool, m2, n2, c21, ldc, c22, ldc, c22, ldc, matrix_plus());  // C22 = U3 + P5
+	combine(pool, m2, n2, c12, ldc, c11, ldc, c12, ldc, matrix_plus());  // C12 = U4 + P3
+	combine(pool, k2, n2, y, ldy, b21, ldb, y, ldy, matrix_minus());     // T4 = T2 - B21
+	multiply(pool, m2, k2, n2, a22, lda, y, ldy, c11, ldc, next, cut);   // P4 = A22 T4
+	combine(pool, m2, n2, c21, ldc, c11, ldc, c21, ldc, matrix_minus()); // C21 = U3 - P4
+	multiply(pool, m2, k2, n2, a12, lda, b21, ldb, c11, ldc, next, cut); // P2 = A12 B21
+	combine(pool, m2, n2, c11, ldc, x, ldx, c11, ldc, matrix_plus());    // C11 = P1 + P2
+
+	// dynamic peeling of whatever the halving dropped
+	int m0 = 2*m2, k0 = 2*k2, n0 = 2*n2;
+	if (k0 < k)
+		safe_gemm::gemm(pool, m0, n0, 1, T(1), a + k0, lda, 1, b + k0*ldb, ldb, 1, T(1), c, ldc);
+	if (n0 < n)
+		safe_gemm::gemm(pool, m0, 1, k, T(1), a, lda, 1, b + n0, ldb, 1, T(0), c + n0, ldc);
+	if (m0 < m)
+		safe_gemm::gemm(pool, 1, n, k, T(1), a + m0*lda, lda, 1, b, ldb, 1, T(0), c + m0*ldc, ldc);
+}
+
+}
+
+// scratch for strassen_multiply, kept between calls so repeated products
+// of the same size allocate nothing
+template <typename T>
+class strassen_arena {
+private:
+	safe_array<T> _buf;
+
+public:
+	strassen_arena();
+
+	void reserve(int, int, int, int=safe_strassen::cutoff);
+	int capacity() const;
+	T* data();
+};
+
+template <typename T>
+strassen_arena<T>::strassen_arena()
+{ }
+
+template <typename T>
+void strassen_arena<T>::reserve(int m, int k, int n, int cutoff) {
+	long long need = safe_strassen::workspace(m, k, n, cutoff);
+	if (need > INT_MAX)
+		throw std::length_error
+		(
+			"strassen workspace too large: " + std::to_string(need)
+		);
+
+	if (need > _buf.size())
+		_buf = safe_array<T>(static_cast<int>(need));
+}
+
+template <typename T>
+inline int strassen_arena<T>::capacity() const {
+	return _buf.size();
+}
+
+template <typename T>
+inline T* strassen_arena<T>::data() {
+	return _buf.data();
+}
+
+// opt-in replacement for A * B on large operands; same result shape and
+// 0-based bounds as operator*. cutoffs below 16 are raised to 16
+template <typename T>
+safe_matrix<T> strassen_multiply(const safe_matrix<T>& a, const safe_matrix<T>& b,
+                                 strassen_arena<T>& arena, int cutoff = safe_strassen::cutoff)
+{
+	if (a.cols() != b.rows())
+		throw std::length_error
+		(
+			"IMPOSSIBLE"
+		);
+
+	cutoff = std::max(cutoff, 16);
+	arena.reserve(a.rows(), a.cols(), b.cols(), cutoff);
+
+	safe_matrix<T> r_sm(a.rows(), b.cols());
+	safe_strassen::multiply(thread_pool::shared(), a.rows(), a.cols(), b.cols(),
+	                        a.data(), a.stride(), b.data(), b.stride(),
+	                        r_sm.data(), r_sm.stride(), arena.data(), cutoff);
+
+	return r_sm;
+}
+
+template <typename T>
+safe_matrix<T> strassen_multiply(const safe_matrix<T>& a, const safe_matrix<T>& b,
+                                 int cutoff = safe_strassen::cutoff)
+{
+	strassen_arena<T> arena;
+	return strassen_multiply(a, b, arena, cutoff);
+}
+
+#endif
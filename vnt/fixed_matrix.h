@@ -0,0 +1,379 @@
+#ifndef SAFE_FIXED_MATRIX
+#define SAFE_FIXED_MATRIX
+
+#include <ostream>
+#include <istream>
+#include <initializer_list>
+#include <type_traits>
+#include <stdexcept>
+#include <cstddef>
+#include <algorithm>
+#include "safe_array.h"
+#include "gemm.h"
+#include "matrix_expr.h"
+#include "matrix_view.h"
+
+// the widest alignment up to 64 bytes that divides the whole matrix, so a
+// small one lines up with the vector registers without growing
+template <typename T>
+constexpr std::size_t safe_matrix_fixed_align(std::size_t n, std::size_t align = 64) {
+	return align <= alignof(T) ? alignof(T)
+		: n * sizeof(T) % align == 0 ? align : safe_matrix_fixed_align<T>(n, align / 2);
+}
+
+// R x C elements held inline, row-major, with row indices R0 .. R0+R-1 and
+// column indices C0 .. C0+C-1. every loop runs to a compile-time bound, so
+// the small sizes this is meant for unroll and vectorize completely and
+// nothing touches the heap or the thread pool. operands whose dimensions
+// cannot match fail to compile. it is a matrix expression like safe_matrix<T>
+// and mixes with it freely; mixed arithmetic is checked at run time and
+// gives a dynamic, 0-based result
+template <typename T, int R, int C, int R0, int C0>
+class safe_matrix : public matrix_expr< safe_matrix<T, R, C, R0, C0> > {
+	static_assert(R > 0 && C > 0, "fixed matrix dimensions must be positive");
+
+private:
+	alignas(safe_matrix_fixed_align<T>(R * C)) T _mat[R * C];
+
+public:
+	typedef T value_type;
+	typedef safe_span<T> row_type;
+	typedef safe_span<const T> const_row_type;
+
+	safe_matrix();
+	safe_matrix(std::initializer_list<T>);
+
+	template <typename E>
+	safe_matrix(const matrix_expr<E>&);
+
+	static constexpr int row_lo();
+	static constexpr int row_hi();
+	static constexpr int col_lo();
+	static constexpr int col_hi();
+	static constexpr int rows();
+	static constexpr int cols();
+	static constexpr int stride();
+	T* data();
+	const T* data() const;
+
+	matrix_view<T> view();
+	matrix_view<const T> view() const;
+
+	safe_matrix<T, C, R, C0, R0> transpose() const;
+	row_type operator[](int);
+	const_row_type operator[](int) const;
+	T& operator()(int, int);
+	const T& operator()(int, int) const;
+
+	template <typename E>
+	safe_matrix& operator=(const matrix_expr<E>&);
+
+	template <typename E>
+	safe_matrix& operator+=(const matrix_expr<E>&);
+
+	template <typename E>
+	safe_matrix& operator-=(const matrix_expr<E>&);
+
+	safe_matrix& operator*=(const T&);
+};
+
+// an R x C destination for e: a fixed shape is checked by the compiler, any
+// other at run time
+template <int R, int C, typename E>
+void safe_matrix_fixed_check(const E& e) {
+	static_assert(!matrix_static_shape<E>::rows || matrix_static_shape<E>::rows == R, "matrix dimension mismatch");
+	static_assert(!matrix_static_shape<E>::cols || matrix_static_shape<E>::cols == C, "matrix dimension mismatch");
+
+	if ((!matrix_static_shape<E>::rows && e.rows() != R) || (!matrix_static_shape<E>::cols && e.cols() != C))
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+}
+
+template <int R, int C, typename T, typename E, typename Op>
+inline void safe_matrix_fixed_eval(T* dst, const E& e, Op op) {
+	safe_matrix_fixed_check<R, C>(e);
+	typename matrix_operand<E>::type x(e);
+
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < R; ++i)
+		SAFE_GEMM_UNROLL
+		for (int j = 0; j < C; ++j)
+			op(dst[i*C + j], x.coeff(i, j));
+}
+
+// trivial element types are left uninitialized, as in safe_matrix<T>
+template <typename T, int R, int C, int R0, int C0>
+inline safe_matrix<T, R, C, R0, C0>::safe_matrix()
+{ }
+
+// row-major
+template <typename T, int R, int C, int R0, int C0>
+safe_matrix<T, R, C, R0, C0>::safe_matrix(std::initializer_list<T> list) {
+	if (list.size() != static_cast<std::size_t>(R * C))
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	std::copy(list.begin(), list.end(), _mat);
+}
+
+template <typename T, int R, int C, int R0, int C0>
+template <typename E>
+inline safe_matrix<T, R, C, R0, C0>::safe_matrix(const matrix_expr<E>& e) {
+	safe_matrix_fixed_eval<R, C>(_mat, e.self(), matrix_assign());
+}
+
+template <typename T, int R, int C, int R0, int C0>
+constexpr int safe_matrix<T, R, C, R0, C0>::row_lo() {
+	return R0;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+constexpr int safe_matrix<T, R, C, R0, C0>::row_hi() {
+	return R0 + R-1;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+constexpr int safe_matrix<T, R, C, R0, C0>::col_lo() {
+	return C0;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+constexpr int safe_matrix<T, R, C, R0, C0>::col_hi() {
+	return C0 + C-1;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+constexpr int safe_matrix<T, R, C, R0, C0>::rows() {
+	return R;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+constexpr int safe_matrix<T, R, C, R0, C0>::cols() {
+	return C;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+constexpr int safe_matrix<T, R, C, R0, C0>::stride() {
+	return C;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline T* safe_matrix<T, R, C, R0, C0>::data() {
+	return _mat;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline const T* safe_matrix<T, R, C, R0, C0>::data() const {
+	return _mat;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline matrix_view<T> safe_matrix<T, R, C, R0, C0>::view() {
+	return matrix_view<T>(_mat, R0, row_hi(), C0, col_hi(), C, 1);
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline matrix_view<const T> safe_matrix<T, R, C, R0, C0>::view() const {
+	return matrix_view<const T>(_mat, R0, row_hi(), C0, col_hi(), C, 1);
+}
+
+// keeps the bounds, swapped
+template <typename T, int R, int C, int R0, int C0>
+safe_matrix<T, C, R, C0, R0> safe_matrix<T, R, C, R0, C0>::transpose() const {
+	safe_matrix<T, C, R, C0, R0> r_sm;
+	T *t = r_sm.data();
+
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < R; ++i)
+		SAFE_GEMM_UNROLL
+		for (int j = 0; j < C; ++j)
+			t[j*R + i] = _mat[i*C + j];
+
+	return r_sm;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline safe_span<T> safe_matrix<T, R, C, R0, C0>::operator[](int i) {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, R0, row_hi())))
+		safe_array_out_of_range("row", i);
+
+	return row_type(_mat + (i-R0) * C, C0, col_hi());
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline safe_span<const T> safe_matrix<T, R, C, R0, C0>::operator[](int i) const {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, R0, row_hi())))
+		safe_array_out_of_range("row", i);
+
+	return const_row_type(_mat + (i-R0) * C, C0, col_hi());
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline T& safe_matrix<T, R, C, R0, C0>::operator()(int i, int j) {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, R0, row_hi())))
+		safe_array_out_of_range("row", i);
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(j, C0, col_hi())))
+		safe_array_out_of_range("column", j);
+
+	return _mat[(i-R0) * C + (j-C0)];
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline const T& safe_matrix<T, R, C, R0, C0>::operator()(int i, int j) const {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, R0, row_hi())))
+		safe_array_out_of_range("row", i);
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(j, C0, col_hi())))
+		safe_array_out_of_range("column", j);
+
+	return _mat[(i-R0) * C + (j-C0)];
+}
+
+// evaluated into a temporary first, so e may read this matrix in any order
+template <typename T, int R, int C, int R0, int C0>
+template <typename E>
+inline safe_matrix<T, R, C, R0, C0>& safe_matrix<T, R, C, R0, C0>::operator=(const matrix_expr<E>& e) {
+	safe_matrix r_sm(e);
+	return *this = r_sm;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+template <typename E>
+inline safe_matrix<T, R, C, R0, C0>& safe_matrix<T, R, C, R0, C0>::operator+=(const matrix_expr<E>& e) {
+	if (safe_matrix_alias(e.self(), view()))
+		return *this += safe_matrix(e);
+
+	safe_matrix_fixed_eval<R, C>(_mat, e.self(), matrix_add_assign());
+	return *this;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+template <typename E>
+inline safe_matrix<T, R, C, R0, C0>& safe_matrix<T, R, C, R0, C0>::operator-=(const matrix_expr<E>& e) {
+	if (safe_matrix_alias(e.self(), view()))
+		return *this -= safe_matrix(e);
+
+	safe_matrix_fixed_eval<R, C>(_mat, e.self(), matrix_sub_assign());
+	return *this;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+inline safe_matrix<T, R, C, R0, C0>& safe_matrix<T, R, C, R0, C0>::operator*=(const T& s) {
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < R * C; ++i)
+		_mat[i] *= s;
+
+	return *this;
+}
+
+// between two fixed matrices the arithmetic below is eager and the result
+// fixed and 0-based. the enable_if keeps safe_matrix<T> on the lazy path
+template <typename T, int R, int C, int R0, int C0, int M, int N, int M0, int N0>
+typename std::enable_if<(R > 0 && C > 0 && M > 0 && N > 0), safe_matrix<T, R, C> >::type
+operator+(const safe_matrix<T, R, C, R0, C0>& a, const safe_matrix<T, M, N, M0, N0>& b) {
+	static_assert(R == M && C == N, "matrix dimension mismatch");
+	safe_matrix<T, R, C> r_sm;
+	const T *x = a.data(), *y = b.data();
+	T *z = r_sm.data();
+
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < R * C; ++i)
+		z[i] = x[i] + y[i];
+
+	return r_sm;
+}
+
+template <typename T, int R, int C, int R0, int C0, int M, int N, int M0, int N0>
+typename std::enable_if<(R > 0 && C > 0 && M > 0 && N > 0), safe_matrix<T, R, C> >::type
+operator-(const safe_matrix<T, R, C, R0, C0>& a, const safe_matrix<T, M, N, M0, N0>& b) {
+	static_assert(R == M && C == N, "matrix dimension mismatch");
+	safe_matrix<T, R, C> r_sm;
+	const T *x = a.data(), *y = b.data();
+	T *z = r_sm.data();
+
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < R * C; ++i)
+		z[i] = x[i] - y[i];
+
+	return r_sm;
+}
+
+// i-k-j with whole rows of b broadcast against one element of a, so each
+// row of the result is a handful of vector multiply-adds
+template <typename T, int R, int C, int R0, int C0, int M, int N, int M0, int N0>
+typename std::enable_if<(R > 0 && C > 0 && M > 0 && N > 0), safe_matrix<T, R, N> >::type
+operator*(const safe_matrix<T, R, C, R0, C0>& a, const safe_matrix<T, M, N, M0, N0>& b) {
+	static_assert(C == M, "matrix dimension mismatch");
+	safe_matrix<T, R, N> r_sm;
+	const T *x = a.data(), *y = b.data();
+	T *z = r_sm.data();
+
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < R; ++i) {
+		SAFE_GEMM_UNROLL
+		for (int j = 0; j < N; ++j)
+			z[i*N + j] = T(0);
+
+		SAFE_GEMM_UNROLL
+		for (int p = 0; p < C; ++p) {
+			const T x_ip = x[i*C + p];
+			SAFE_GEMM_UNROLL
+			for (int j = 0; j < N; ++j)
+				z[i*N + j] += x_ip * y[p*N + j];
+		}
+	}
+
+	return r_sm;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+typename std::enable_if<(R > 0 && C > 0), safe_matrix<T, R, C> >::type
+operator*(const typename safe_matrix<T, R, C, R0, C0>::value_type& s, const safe_matrix<T, R, C, R0, C0>& a) {
+	safe_matrix<T, R, C> r_sm;
+	const T *x = a.data();
+	T *z = r_sm.data();
+
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < R * C; ++i)
+		z[i] = s * x[i];
+
+	return r_sm;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+typename std::enable_if<(R > 0 && C > 0), safe_matrix<T, R, C> >::type
+operator*(const safe_matrix<T, R, C, R0, C0>& a, const typename safe_matrix<T, R, C, R0, C0>::value_type& s) {
+	safe_matrix<T, R, C> r_sm;
+	const T *x = a.data();
+	T *z = r_sm.data();
+
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < R * C; ++i)
+		z[i] = x[i] * s;
+
+	return r_sm;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+typename std::enable_if<(R > 0 && C > 0), std::ostream&>::type
+operator<<(std::ostream& out, const safe_matrix<T, R, C, R0, C0>& sm) {
+	for (int i = 0; i < R; ++i)
+		for (int j = 0; j < C; ++j)
+			out << sm.data()[i*C + j] << (j+1 < C ? ' ' : '\n');
+
+	return out;
+}
+
+template <typename T, int R, int C, int R0, int C0>
+typename std::enable_if<(R > 0 && C > 0), std::istream&>::type
+operator>>(std::istream& in, safe_matrix<T, R, C, R0, C0>& sm) {
+	for (int i = 0; i < R * C; ++i)
+		in >> sm.data()[i];
+
+	return in;
+}
+
+#endif
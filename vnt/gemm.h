@@ -0,0 +1,466 @@
+#ifndef SAFE_GEMM
+#define SAFE_GEMM
+
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cstddef>
+#include "safe_array.h"
+#include "thread_pool.h"
+
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+#define SAFE_GEMM_SIMD
+#if defined(__x86_64__) || defined(__i386__)
+#define SAFE_GEMM_X86
+#endif
+#endif
+
+// the register tile only stays in registers when its loops are fully unrolled
+#if defined(__clang__)
+#define SAFE_GEMM_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define SAFE_GEMM_UNROLL _Pragma("GCC unroll 16")
+#else
+#define SAFE_GEMM_UNROLL
+#endif
+
+// C = alpha * A * B + beta * C, with A m x k, B k x n and C m x n. A and B take
+// a row and a column stride, so transposed operands need no copy; C is row-major.
+//
+// the layout follows the BLIS/GotoBLAS scheme: B is packed into kc x nc panels
+// that stay in L3, A into mc x kc blocks that stay in L2, and an mr x nr
+// micro-kernel keeps its tile of C in vector registers while streaming one
+// kc-long sliver of each packed operand out of L1
+namespace safe_gemm {
+
+const std::size_t l2_bytes = 256 * 1024;
+const std::size_t l3_bytes = 2 * 1024 * 1024;
+
+// below this many multiply-adds packing costs more than it saves
+const long long small_max = 32 * 32 * 32;
+
+// below this many multiply-adds the product stays on the calling thread
+const long long parallel_min = 128 * 128 * 128;
+
+// float, double and the non-bool integers have vector kernels
+template <typename T>
+struct use_simd : std::integral_constant<bool,
+#ifdef SAFE_GEMM_SIMD
+	std::is_arithmetic<T>::value && !std::is_same<T, bool>::value
+	&& !std::is_same<T, long double>::value
+#else
+	false
+#endif
+	> { };
+
+// W is the vector width in bytes: 16 for the baseline build, 32 for AVX2 and
+// 64 for AVX-512. the register tile is sized to fill most of the register file
+// (12 of 16 ymm, 24 of 32 zmm) while leaving room for the B sliver and the
+// broadcast of A
+template <typename T, int W>
+struct blocking {
+	static const int lanes = W / sizeof(T) > 0 ? W / sizeof(T) : 1;
+	static const int mr = W == 64 ? 12 : 6;
+	static const int nv = 2;
+	static const int nr = nv * lanes;
+	static const int kc = 256;
+	static const int mc = std::size_t(mr) * kc * sizeof(T) > l2_bytes / 2 ? mr :
+		int(l2_bytes / 2 / (kc * sizeof(T)) / mr * mr);
+	static const int nc = std::size_t(nr) * kc * sizeof(T) > l3_bytes / 2 ? nr :
+		int(l3_bytes / 2 / (kc * sizeof(T)) / nr * nr);
+};
+
+// 0 baseline, 1 AVX2 with FMA, 2 AVX-512; probed once
+inline int cpu_level() {
+#ifdef SAFE_GEMM_X86
+	static const int level =
+		__builtin_cpu_supports("avx512f") ? 2 :
+		__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? 1 : 0;
+	return level;
+#else
+	return 0;
+#endif
+}
+
+// rows of A are copied into mr-wide slivers, column by column, zero-padded at the edge
+template <typename T, int MR>
+void pack_a(int mc, int kc, const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa, T* buf) {
+	for (int ir = 0; ir < mc; ir += MR) {
+		int rows = std::min(MR, mc - ir);
+
+		for (int i = 0; i < rows; ++i) {
+			const T *row = a + (ir+i) * rsa;
+			for (int p = 0; p < kc; ++p)
+				buf[p*MR + i] = row[p * csa];
+		}
+		for (int i = rows; i < MR; ++i)
+			for (int p = 0; p < kc; ++p)
+				buf[p*MR + i] = T(0);
+
+		buf += static_cast<std::ptrdiff_t>(MR) * kc;
+	}
+}
+
+// columns of B are copied into nr-wide slivers, row by row, zero-padded at the edge
+template <typename T, int NR>
+void pack_b(int kc, int nc, const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb, T* buf) {
+	for (int jr = 0; jr < nc; jr += NR) {
+		int cols = std::min(NR, nc - jr);
+
+		for (int p = 0; p < kc; ++p) {
+			const T *row = b + p * rsb + jr * csb;
+			T *out = buf + p*NR;
+
+			if (csb == 1)
+				std::memcpy(out, row, sizeof(T) * cols);
+			else
+				for (int j = 0; j < cols; ++j)
+					out[j] = row[j * csb];
+			for (int j = cols; j < NR; ++j)
+				out[j] = T(0);
+		}
+
+		buf += static_cast<std::ptrdiff_t>(NR) * kc;
+	}
+}
+
+#ifdef SAFE_GEMM_SIMD
+
+// one mr x nr tile of C from a packed sliver of A and of B. partial tiles at
+// the right and bottom edges go through a scratch tile so the vector loop
+// never changes shape
+template <typename T, int W>
+inline void micro_kernel(int kc, const T* a, const T* b, T* c, std::ptrdiff_t ldc,
+                         T alpha, T beta, int mr, int nr)
+{
+	typedef blocking<T, W> blk;
+	typedef T vec __attribute__((vector_size(blk::lanes * sizeof(T))));
+	const int L = blk::lanes, MR = blk::mr, NV = blk::nv, NR = blk::nr;
+
+	vec acc[MR][NV];
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < MR; ++i)
+		SAFE_GEMM_UNROLL
+		for (int v = 0; v < NV; ++v)
+			acc[i][v] = vec{};
+
+	for (int p = 0; p < kc; ++p) {
+		vec bv[NV];
+		SAFE_GEMM_UNROLL
+		for (int v = 0; v < NV; ++v)
+			std::memcpy(&bv[v], b + v*L, sizeof(vec));
+
+		SAFE_GEMM_UNROLL
+		for (int i = 0; i < MR; ++i) {
+			vec av = a[i] - vec{};	// broadcast; x - 0 folds where 0 + x cannot
+			SAFE_GEMM_UNROLL
+			for (int v = 0; v < NV; ++v)
+				acc[i][v] += av * bv[v];
+		}
+
+		a += MR;
+		b += NR;
+	}
+
+	T tile[MR * NR];
+	bool full = mr == MR && nr == NR;
+	T *out = full ? c : tile;
+	std::ptrdiff_t ld = full ? ldc : NR;
+
+	if (!full) {
+		std::fill(tile, tile + MR*NR, T(0));
+		for (int i = 0; i < mr; ++i)
+			for (int j = 0; j < nr; ++j)
+				tile[i*NR + j] = c[i*ldc + j];
+	}
+
+	SAFE_GEMM_UNROLL
+	for (int i = 0; i < MR; ++i) {
+		SAFE_GEMM_UNROLL
+		for (int v = 0; v < NV; ++v) {
+			vec r = acc[i][v] * alpha;
+			if (beta != T(0)) {
+				vec cv;
+				std::memcpy(&cv, out + i*ld + v*L, sizeof(vec));
+				r += cv * beta;
+			}
+			std::memcpy(out + i*ld + v*L, &r, sizeof(vec));
+		}
+	}
+
+	if (!full)
+		for (int i = 0; i < mr; ++i)
+			for (int j = 0; j < nr; ++j)
+				c[i*ldc + j] = tile[i*NR + j];
+}
+
+// an mc x nc block of C from a packed block of A and panel of B
+template <typename T, int W>
+inline void macro_kernel(int mc, int nc, int kc, const T* pa, const T* pb, T* c,
+                         std::ptrdiff_t ldc, T alpha, T beta)
+{
+	const int MR = blocking<T, W>::mr, NR = blocking<T, W>::nr;
+
+	for (int jr = 0; jr < nc; jr += NR) {
+		int nr = std::min(NR, nc - jr);
+		const T *b = pb + static_cast<std::ptrdiff_t>(jr) * kc;
+
+		for (int ir = 0; ir < mc; ir += MR) {
+			int mr = std::min(MR, mc - ir);
+			const T *a = pa + static_cast<std::ptrdiff_t>(ir) * kc;
+
+			micro_kernel<T, W>(kc, a, b, c + ir*ldc + jr, ldc, alpha, beta, mr, nr);
+		}
+	}
+}
+
+// one entry point per instruction set. flatten pulls the kernels above into
+// the target-specific body, so the vector code is generated for that ISA
+template <typename T, int W>
+struct isa {
+	static void macro(int mc, int nc, int kc, const T* pa, const T* pb, T* c,
+	                  std::ptrdiff_t ldc, T alpha, T beta)
+	{
+		macro_kernel<T, W>(mc, nc, kc, pa, pb, c, ldc, alpha, beta);
+	}
+};
+
+#ifdef SAFE_GEMM_X86
+template <typename T>
+struct isa<T, 32> {
+	__attribute__((target("avx2,fma"), flatten))
+	static void macro(int mc, int nc, int kc, const T* pa, const T* pb, T* c,
+	                  std::ptrdiff_t ldc, T alpha, T beta)
+	{
+		macro_kernel<T, 32>(mc, nc, kc, pa, pb, c, ldc, alpha, beta);
+	}
+};
+
+template <typename T>
+struct isa<T, 64> {
+	__attribute__((target("avx512f,avx2,fma"), flatten))
+	static void macro(int mc, int nc, int kc, const T* pa, const T* pb, T* c,
+	                  std::ptrdiff_t ldc, T alpha, T beta)
+	{
+		macro_kernel<T, 64>(mc, nc, kc, pa, pb, c, ldc, alpha, beta);
+	}
+};
+#endif
+
+template <typename T, int W>
+void blocked(int m, int n, int k, T alpha,
+             const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+             const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+             T beta, T* c, std::ptrdiff_t ldc)
+{
+	typedef blocking<T, W> blk;
+	const int MR = blk::mr, NR = blk::nr, MC = blk::mc, NC = blk::nc, KC = blk::kc;
+
+	int mc_max = std::min(MC, (m + MR-1) / MR * MR);
+	int nc_max = std::min(NC, (n + NR-1) / NR * NR);
+	int kc_max = std::min(KC, k);
+
+	safe_array<T> pa(mc_max * kc_max), pb(kc_max * nc_max);
+
+	for (int jc = 0; jc < n; jc += NC) {
+		int nc = std::min(NC, n - jc);
+
+		for (int pc = 0; pc < k; pc += KC) {
+			int kc = std::min(KC, k - pc);
+			T beta_p = pc == 0 ? beta : T(1);
+
+			pack_b<T, blk::nr>(kc, nc, b + pc*rsb + jc*csb, rsb, csb, pb.data());
+
+			for (int ic = 0; ic < m; ic += MC) {
+				int mc = std::min(MC, m - ic);
+
+				pack_a<T, blk::mr>(mc, kc, a + ic*rsa + pc*csa, rsa, csa, pa.data());
+				isa<T, W>::macro(mc, nc, kc, pa.data(), pb.data(), c + ic*ldc + jc, ldc, alpha, beta_p);
+			}
+		}
+	}
+}
+
+#endif
+
+// i-k-j over raw rows; used for small products and for types without vector kernels
+template <typename T>
+void generic(int m, int n, int k, T alpha,
+             const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+             const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+             T beta, T* c, std::ptrdiff_t ldc)
+{
+	for (int i = 0; i < m; ++i) {
+		T *c_row = c + i*ldc;
+
+		for (int j = 0; j < n; ++j)
+			c_row[j] = beta == T(0) ? T(0) : beta * c_row[j];
+
+		for (int p = 0; p < k; ++p) {
+			const T a_ip = alpha * a[i*rsa + p*csa];
+			const T *b_row = b + p*rsb;
+
+			for (int j = 0; j < n; ++j)
+				c_row[j] += a_ip * b_row[j*csb];
+		}
+	}
+}
+
+template <typename T>
+void gemm(int m, int n, int k, T alpha,
+          const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+          const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+          T beta, T* c, std::ptrdiff_t ldc, std::false_type)
+{
+	generic(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+}
+
+template <typename T>
+void gemm(int m, int n, int k, T alpha,
+          const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+          const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+          T beta, T* c, std::ptrdiff_t ldc, std::true_type)
+{
+#ifdef SAFE_GEMM_SIMD
+	if (k == 0 || static_cast<long long>(m) * n * k < small_max) {
+		generic(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+		return;
+	}
+
+	switch (cpu_level()) {
+	case 2:
+		blocked<T, 64>(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+		break;
+	case 1:
+		blocked<T, 32>(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+		break;
+	default:
+		blocked<T, 16>(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+	}
+#else
+	generic(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+#endif
+}
+
+template <typename T>
+void gemm(int m, int n, int k, T alpha,
+          const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+          const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+          T beta, T* c, std::ptrdiff_t ldc)
+{
+	if (m <= 0 || n <= 0) return;
+	gemm(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, ldc, use_simd<T>());
+}
+
+// C = A * B for strided operands and a row-major C. other T only need T(0), += and *
+template <typename T>
+void multiply(int m, int n, int k,
+              const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+              const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+              T* c, std::ptrdiff_t ldc, std::true_type)
+{
+	gemm(m, n, k, T(1), a, rsa, csa, b, rsb, csb, T(0), c, ldc, std::true_type());
+}
+
+template <typename T>
+void multiply(int m, int n, int k,
+              const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+              const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+              T* c, std::ptrdiff_t ldc, std::false_type)
+{
+	for (int i = 0; i < m; ++i) {
+		const T *a_row = a + i*rsa;
+		T *c_row = c + i*ldc;
+
+		for (int j = 0; j < n; ++j)
+			c_row[j] = 0;
+
+		for (int p = 0; p < k; ++p) {
+			const T a_ip = a_row[p*csa];
+			const T *b_row = b + p*rsb;
+
+			if (csb == 1)
+				for (int j = 0; j < n; ++j)
+					c_row[j] += a_ip * b_row[j];
+			else
+				for (int j = 0; j < n; ++j)
+					c_row[j] += a_ip * b_row[j*csb];
+		}
+	}
+}
+
+template <typename T>
+void multiply(int m, int n, int k,
+              const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+              const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+              T* c, std::ptrdiff_t ldc)
+{
+	if (m <= 0 || n <= 0) return;
+	multiply(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, use_simd<T>());
+}
+
+// C is cut into a grid of about four tiles per thread; each tile is an
+// independent serial gemm that packs its own slices of A and B. tiles are at
+// least 64 rows by 256 columns so repacking B stays a small fraction of the work
+template <typename T>
+void gemm(thread_pool& pool, int m, int n, int k, T alpha,
+          const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+          const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+          T beta, T* c, std::ptrdiff_t ldc)
+{
+	if (m <= 0 || n <= 0) return;
+	if (pool.size() <= 1 || static_cast<long long>(m) * n * k < parallel_min) {
+		gemm(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, ldc);
+		return;
+	}
+
+	int tasks = 4 * pool.size();
+	int grid_m = std::max(1, std::min(tasks, (m + 63) / 64));
+	int grid_n = std::max(1, std::min((tasks + grid_m-1) / grid_m, (n + 255) / 256));
+	int tile_m = (m + grid_m-1) / grid_m, tile_n = (n + grid_n-1) / grid_n;
+
+	pool.parallel_for(grid_m * grid_n, [&](int t) {
+		int i = t / grid_n * tile_m, j = t % grid_n * tile_n;
+		if (i >= m || j >= n) return;
+
+		gemm(std::min(tile_m, m - i), std::min(tile_n, n - j), k, alpha,
+		     a + i*rsa, rsa, csa, b + j*csb, rsb, csb, beta, c + i*ldc + j, ldc);
+	});
+}
+
+template <typename T>
+void multiply(thread_pool& pool, int m, int n, int k,
+              const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+              const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+              T* c, std::ptrdiff_t ldc, std::true_type)
+{
+	gemm(pool, m, n, k, T(1), a, rsa, csa, b, rsb, csb, T(0), c, ldc);
+}
+
+template <typename T>
+void multiply(thread_pool& pool, int m, int n, int k,
+              const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+              const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+              T* c, std::ptrdiff_t ldc, std::false_type)
+{
+	long long work = static_cast<long long>(n) * k;
+	int grain = static_cast<int>(std::max(1LL, parallel_min / std::max(1LL, work)));
+
+	pool.parallel_range(m, grain, [&](int lo, int hi) {
+		multiply(hi - lo, n, k, a + lo*rsa, rsa, csa, b, rsb, csb, c + lo*ldc, ldc, std::false_type());
+	});
+}
+
+template <typename T>
+void multiply(thread_pool& pool, int m, int n, int k,
+              const T* a, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+              const T* b, std::ptrdiff_t rsb, std::ptrdiff_t csb,
+              T* c, std::ptrdiff_t ldc)
+{
+	if (m <= 0 || n <= 0) return;
+	multiply(pool, m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, use_simd<T>());
+}
+
+}
+
+#endif
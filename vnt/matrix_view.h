@@ -0,0 +1,425 @@
+#ifndef MATRIX_VIEW
+#define MATRIX_VIEW
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <type_traits>
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+#include "safe_array.h"
+#include "thread_pool.h"
+#include "matrix_expr.h"
+
+// element-wise work below this many elements stays on the calling thread
+const int safe_matrix_parallel_min = 1 << 16;
+
+// a window onto elements owned by something else: element (i, j) lives at
+// data + (i-row_lo) * row_stride + (j-col_lo) * col_stride. blocks, rows,
+// columns and transposes of a matrix are all views of this form, so none of
+// them copies, and a view can stand wherever a matrix expression can.
+// assigning to a view writes through to the elements it covers
+template <typename T>
+class matrix_view : public matrix_expr< matrix_view<T> > {
+private:
+	T *_data;
+	std::ptrdiff_t _rs, _cs;
+	int _r_lo, _r_hi, _c_lo, _c_hi;
+
+	T* at(int, int) const;
+
+public:
+	typedef typename std::remove_cv<T>::type value_type;
+
+	matrix_view(T*, int, int, int, int, std::ptrdiff_t, std::ptrdiff_t);
+	matrix_view(const matrix_view&) = default;
+
+	template <typename U, typename = typename std::enable_if
+		<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+	matrix_view(const matrix_view<U>&);
+
+	int row_lo() const;
+	int row_hi() const;
+	int col_lo() const;
+	int col_hi() const;
+	int rows() const;
+	int cols() const;
+	std::ptrdiff_t row_stride() const;
+	std::ptrdiff_t col_stride() const;
+	T* data() const;
+
+	matrix_view block(int, int, int, int) const;
+	matrix_view row(int) const;
+	matrix_view col(int) const;
+	matrix_view transposed() const;
+
+	T& operator()(int, int) const;
+	const T& coeff(int, int) const;
+
+	matrix_view& operator=(const matrix_view&);
+
+	template <typename E>
+	matrix_view& operator=(const matrix_expr<E>&);
+
+	template <typename E>
+	matrix_view& operator+=(const matrix_expr<E>&);
+
+	template <typename E>
+	matrix_view& operator-=(const matrix_expr<E>&);
+
+	matrix_view& operator*=(const value_type&);
+};
+
+// whether two views share any memory. only the address ranges are compared,
+// so interleaved views that never touch the same element still count
+template <typename T, typename U>
+bool safe_matrix_overlap(const matrix_view<T>& x, const matrix_view<U>& y) {
+	const void *x_lo = x.data(), *y_lo = y.data();
+	const void *x_hi = x.data() + (x.rows()-1) * x.row_stride() + (x.cols()-1) * x.col_stride();
+	const void *y_hi = y.data() + (y.rows()-1) * y.row_stride() + (y.cols()-1) * y.col_stride();
+	std::less<const void*> less;
+
+	return !less(x_hi, y_lo) && !less(y_hi, x_lo);
+}
+
+// whether evaluating an expression element by element into out could read an
+// element after storing to it: some matrix or view in the expression shares
+// memory with out but starts or steps differently. reading out itself, each
+// element at its own position, is fine. nodes not listed here read nothing
+template <typename E, typename T>
+bool safe_matrix_alias(const matrix_expr<E>&, const matrix_view<T>&) {
+	return false;
+}
+
+template <typename U, typename T>
+bool safe_matrix_alias(const matrix_view<U>& x, const matrix_view<T>& out) {
+	if (x.data() == out.data() && x.row_stride() == out.row_stride() && x.col_stride() == out.col_stride())
+		return false;
+
+	return safe_matrix_overlap(x, out);
+}
+
+template <typename U, typename T>
+bool safe_matrix_alias(const matrix_leaf<U>& x, const matrix_view<T>& out) {
+	return safe_matrix_alias(matrix_view<const U>(x.data(), 0, x.rows()-1, 0, x.cols()-1, x.stride(), 1), out);
+}
+
+template <typename U, int R, int C, int R0, int C0, typename T>
+bool safe_matrix_alias(const safe_matrix<U, R, C, R0, C0>& x, const matrix_view<T>& out) {
+	return safe_matrix_alias(x.view(), out);
+}
+
+template <typename L, typename R, typename Op, typename T>
+bool safe_matrix_alias(const matrix_binary<L, R, Op>& x, const matrix_view<T>& out) {
+	return safe_matrix_alias(x.lhs(), out) || safe_matrix_alias(x.rhs(), out);
+}
+
+template <typename E, bool Left, typename T>
+bool safe_matrix_alias(const matrix_scaled<E, Left>& x, const matrix_view<T>& out) {
+	return safe_matrix_alias(x.expr(), out);
+}
+
+// copies a rows x cols block between two strided layouts by halving the
+// longer side until the block is a 32 x 32 tile. whatever the strides, both
+// sides are then walked in pieces that stay in L1, at every cache size
+template <typename T>
+void safe_matrix_copy_block(int rows, int cols, const T* src, std::ptrdiff_t rs, std::ptrdiff_t cs,
+                            T* dst, std::ptrdiff_t rd, std::ptrdiff_t cd)
+{
+	const int tile = 32;
+
+	if (rows <= tile && cols <= tile) {
+		for (int i = 0; i < rows; ++i)
+			for (int j = 0; j < cols; ++j)
+				dst[i*rd + j*cd] = src[i*rs + j*cs];
+		return;
+	}
+
+	if (rows >= cols) {
+		int h = rows / 2;
+		safe_matrix_copy_block(h, cols, src, rs, cs, dst, rd, cd);
+		safe_matrix_copy_block(rows - h, cols, src + h*rs, rs, cs, dst + h*rd, rd, cd);
+	} else {
+		int h = cols / 2;
+		safe_matrix_copy_block(rows, h, src, rs, cs, dst, rd, cd);
+		safe_matrix_copy_block(rows, cols - h, src + h*cs, rs, cs, dst + h*cd, rd, cd);
+	}
+}
+
+// the same, split across the shared pool by rows of the destination. the
+// two sides must not overlap
+template <typename T>
+void safe_matrix_copy(const matrix_view<const T>& src, T* dst, std::ptrdiff_t rd, std::ptrdiff_t cd) {
+	int rows = src.rows(), cols = src.cols();
+	int grain = std::max(1, safe_matrix_parallel_min / cols);
+
+	thread_pool::shared().parallel_range(rows, grain, [&](int lo, int hi) {
+		safe_matrix_copy_block(hi - lo, cols, src.data() + lo*src.row_stride(), src.row_stride(),
+		                       src.col_stride(), dst + lo*rd, rd, cd);
+	});
+}
+
+// swaps the rows x cols block at a with the transpose of the cols x rows
+// block at b, recursing like safe_matrix_copy_block
+template <typename T>
+void safe_matrix_swap_transposed(int rows, int cols, T* a, T* b, std::ptrdiff_t ld) {
+	const int tile = 32;
+
+	if (rows <= tile && cols <= tile) {
+		for (int i = 0; i < rows; ++i)
+			for (int j = 0; j < cols; ++j)
+				std::swap(a[i*ld + j], b[j*ld + i]);
+		return;
+	}
+
+	if (rows >= cols) {
+		int h = rows / 2;
+		safe_matrix_swap_transposed(h, cols, a, b, ld);
+		safe_matrix_swap_transposed(rows - h, cols, a + h*ld, b + h, ld);
+	} else {
+		int h = cols / 2;
+		safe_matrix_swap_transposed(rows, h, a, b, ld);
+		safe_matrix_swap_transposed(rows, cols - h, a + h, b + h*ld, ld);
+	}
+}
+
+// transposes the n x n block at a in place: both diagonal quarters recurse
+// and the off-diagonal ones are swapped
+template <typename T>
+void safe_matrix_transpose_square(int n, T* a, std::ptrdiff_t ld) {
+	const int tile = 32;
+
+	if (n <= tile) {
+		for (int i = 1; i < n; ++i)
+			for (int j = 0; j < i; ++j)
+				std::swap(a[i*ld + j], a[j*ld + i]);
+		return;
+	}
+
+	int h = n / 2;
+	safe_matrix_transpose_square(h, a, ld);
+	safe_matrix_transpose_square(n - h, a + h*ld + h, ld);
+	safe_matrix_swap_transposed(h, n - h, a + h, a + h*ld, ld);
+}
+
+// evaluates an expression into a strided destination of the same shape.
+// the destination may appear in the expression as it is; when a shifted or
+// transposed view of it does, the expression is evaluated into a temporary
+// first
+template <typename T, typename E, typename Op>
+void safe_matrix_eval(T* dst, std::ptrdiff_t rs, std::ptrdiff_t cs, const E& e, Op op) {
+	int rows = e.rows(), cols = e.cols();
+	int grain = std::max(1, safe_matrix_parallel_min / cols);
+
+	if (safe_matrix_alias(e, matrix_view<const T>(dst, 0, rows-1, 0, cols-1, rs, cs))) {
+		safe_array<T> tmp;
+		tmp.resize(rows * cols);
+		safe_matrix_eval(tmp.data(), cols, 1, e, matrix_assign());
+		safe_matrix_eval(dst, rs, cs, matrix_view<const T>(tmp.data(), 0, rows-1, 0, cols-1, cols, 1), op);
+		return;
+	}
+
+	// the loop reads only locals, so stores through d cannot alias its bounds
+	thread_pool::shared().parallel_range(rows, grain, [=, &e](int lo, int hi) {
+		typename matrix_operand<E>::type x(e);
+		for (int i = lo; i < hi; ++i) {
+			T *d = dst + static_cast<std::ptrdiff_t>(i) * rs;
+			if (cs == 1)
+				for (int j = 0; j < cols; ++j)
+					op(d[j], x.coeff(i, j));
+			else
+				for (int j = 0; j < cols; ++j)
+					op(d[j*cs], x.coeff(i, j));
+		}
+	});
+}
+
+// a plain copy out of a view goes through the blocked copy, by way of a
+// temporary when the two sides share memory
+template <typename T, typename U>
+void safe_matrix_eval(T* dst, std::ptrdiff_t rs, std::ptrdiff_t cs, const matrix_view<U>& e, matrix_assign) {
+	matrix_view<const T> src(e);
+	matrix_view<const T> out(dst, 0, src.rows()-1, 0, src.cols()-1, rs, cs);
+
+	if (src.data() == out.data() && src.row_stride() == rs && src.col_stride() == cs)
+		return;
+
+	if (!safe_matrix_overlap(src, out)) {
+		safe_matrix_copy(src, dst, rs, cs);
+		return;
+	}
+
+	safe_array<T> tmp;
+	tmp.resize(src.rows() * src.cols());
+	safe_matrix_copy(src, tmp.data(), src.cols(), 1);
+	safe_matrix_copy(matrix_view<const T>(tmp.data(), 0, src.rows()-1, 0, src.cols()-1, src.cols(), 1), dst, rs, cs);
+}
+
+template <typename T>
+matrix_view<T>::matrix_view(T* data, int i1, int i2, int j1, int j2, std::ptrdiff_t rs, std::ptrdiff_t cs) :
+_data(data), _rs(rs), _cs(cs), _r_lo(i1), _r_hi(i2), _c_lo(j1), _c_hi(j2)
+{
+	int row_size = _r_hi-_r_lo+1, col_size = _c_hi-_c_lo+1;
+	if (row_size <= 0 || col_size <= 0)
+		throw std::length_error
+		(
+			"invalid bounds. row size: " + std::to_string(row_size)
+			+ ", column size: " + std::to_string(col_size)
+		);
+}
+
+template <typename T>
+template <typename U, typename>
+matrix_view<T>::matrix_view(const matrix_view<U>& mv) :
+_data( mv.data() ), _rs( mv.row_stride() ), _cs( mv.col_stride() ),
+_r_lo( mv.row_lo() ), _r_hi( mv.row_hi() ), _c_lo( mv.col_lo() ), _c_hi( mv.col_hi() )
+{ }
+
+template <typename T>
+inline T* matrix_view<T>::at(int i, int j) const {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, _r_lo, _r_hi)))
+		safe_array_out_of_range("row", i);
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(j, _c_lo, _c_hi)))
+		safe_array_out_of_range("column", j);
+
+	return _data + (i-_r_lo) * _rs + (j-_c_lo) * _cs;
+}
+
+template <typename T>
+inline int matrix_view<T>::row_lo() const {
+	return _r_lo;
+}
+
+template <typename T>
+inline int matrix_view<T>::row_hi() const {
+	return _r_hi;
+}
+
+template <typename T>
+inline int matrix_view<T>::col_lo() const {
+	return _c_lo;
+}
+
+template <typename T>
+inline int matrix_view<T>::col_hi() const {
+	return _c_hi;
+}
+
+template <typename T>
+inline int matrix_view<T>::rows() const {
+	return _r_hi-_r_lo+1;
+}
+
+template <typename T>
+inline int matrix_view<T>::cols() const {
+	return _c_hi-_c_lo+1;
+}
+
+template <typename T>
+inline std::ptrdiff_t matrix_view<T>::row_stride() const {
+	return _rs;
+}
+
+template <typename T>
+inline std::ptrdiff_t matrix_view<T>::col_stride() const {
+	return _cs;
+}
+
+template <typename T>
+inline T* matrix_view<T>::data() const {
+	return _data;
+}
+
+// rows i1..i2 and columns j1..j2, indexed as they are here
+template <typename T>
+matrix_view<T> matrix_view<T>::block(int i1, int i2, int j1, int j2) const {
+	if (i2 < i1 || j2 < j1)
+		throw std::length_error
+		(
+			"invalid bounds. row size: " + std::to_string(i2-i1+1)
+			+ ", column size: " + std::to_string(j2-j1+1)
+		);
+
+	at(i2, j2);
+	return matrix_view(at(i1, j1), i1, i2, j1, j2, _rs, _cs);
+}
+
+template <typename T>
+matrix_view<T> matrix_view<T>::row(int i) const {
+	return matrix_view(at(i, _c_lo), i, i, _c_lo, _c_hi, _rs, _cs);
+}
+
+template <typename T>
+matrix_view<T> matrix_view<T>::col(int j) const {
+	return matrix_view(at(_r_lo, j), _r_lo, _r_hi, j, j, _rs, _cs);
+}
+
+// keeps the bounds, swapped
+template <typename T>
+matrix_view<T> matrix_view<T>::transposed() const {
+	return matrix_view(_data, _c_lo, _c_hi, _r_lo, _r_hi, _cs, _rs);
+}
+
+template <typename T>
+inline T& matrix_view<T>::operator()(int i, int j) const {
+	return *at(i, j);
+}
+
+template <typename T>
+inline const T& matrix_view<T>::coeff(int i, int j) const {
+	return _data[i*_rs + j*_cs];
+}
+
+template <typename T>
+matrix_view<T>& matrix_view<T>::operator=(const matrix_view& mv) {
+	return *this = static_cast<const matrix_expr<matrix_view>&>(mv);
+}
+
+// the shapes must match; the bounds need not
+template <typename T>
+template <typename E>
+matrix_view<T>& matrix_view<T>::operator=(const matrix_expr<E>& e) {
+	if (e.self().rows() != rows() || e.self().cols() != cols())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_matrix_eval(_data, _rs, _cs, e.self(), matrix_assign());
+	return *this;
+}
+
+template <typename T>
+template <typename E>
+matrix_view<T>& matrix_view<T>::operator+=(const matrix_expr<E>& e) {
+	if (e.self().rows() != rows() || e.self().cols() != cols())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_matrix_eval(_data, _rs, _cs, e.self(), matrix_add_assign());
+	return *this;
+}
+
+template <typename T>
+template <typename E>
+matrix_view<T>& matrix_view<T>::operator-=(const matrix_expr<E>& e) {
+	if (e.self().rows() != rows() || e.self().cols() != cols())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+
+	safe_matrix_eval(_data, _rs, _cs, e.self(), matrix_sub_assign());
+	return *this;
+}
+
+template <typename T>
+matrix_view<T>& matrix_view<T>::operator*=(const value_type& s) {
+	safe_matrix_eval(_data, _rs, _cs, *this * s, matrix_assign());
+	return *this;
+}
+
+#endif
@@ -6,31 +6,614 @@
 #include <string>
 #include <utility>
 #include <stdexcept>
+#include <type_traits>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <iterator>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <climits>
+#include "safe_sort.h"
 
-template <typename T> 
-class safe_array;
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#if __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SAFE_ARRAY_COLD __attribute__((noinline, cold))
+#define SAFE_ARRAY_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#elif defined(_MSC_VER)
+#define SAFE_ARRAY_COLD __declspec(noinline)
+#define SAFE_ARRAY_UNLIKELY(x) (x)
+#else
+#define SAFE_ARRAY_COLD
+#define SAFE_ARRAY_UNLIKELY(x) (x)
+#endif
+
+struct checked_access {
+	static constexpr bool enabled = true;
+};
+
+struct unchecked_access {
+	static constexpr bool enabled = false;
+};
+
+struct debug_access {
+#ifdef NDEBUG
+	static constexpr bool enabled = false;
+#else
+	static constexpr bool enabled = true;
+#endif
+};
+
+#ifndef SAFE_ARRAY_ACCESS
+#define SAFE_ARRAY_ACCESS checked_access
+#endif
+
+[[noreturn]] SAFE_ARRAY_COLD inline 
+void safe_array_out_of_range(const char *what, int i) {
+	throw std::out_of_range
+	(
+		std::string(what) + " " + std::to_string(i) + " out of range"
+	);
+}
+
+inline bool safe_array_in_range(int i, int lo, int hi) {
+	return static_cast<unsigned>(i) - static_cast<unsigned>(lo) 
+		< static_cast<unsigned>(hi) - static_cast<unsigned>(lo) + 1u;
+}
 
+template <typename Access>
+inline void safe_array_check_range(int low, int high, int lo, int hi) {
+	if (Access::enabled && low <= high && SAFE_ARRAY_UNLIKELY
+		(
+			!safe_array_in_range(low, lo, hi) || !safe_array_in_range(high, lo, hi)
+		))
+		safe_array_out_of_range("range", safe_array_in_range(low, lo, hi) ? high : low);
+}
+
+// a position i in the bounds lo .. hi of the elements at data. moving it
+// anywhere is allowed; reading through it outside lo .. hi throws
 template <typename T>
-std::ostream& operator<<(std::ostream&, const safe_array<T>&);
+class safe_iterator {
+private:
+	T *_data;
+	int _i, _lo, _hi;
+	
+public:
+	typedef std::random_access_iterator_tag iterator_category;
+	typedef typename std::remove_cv<T>::type value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef T& reference;
+	
+	safe_iterator();
+	safe_iterator(T*, int, int, int);
+	
+	template <typename U, typename = typename std::enable_if
+		<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+	safe_iterator(const safe_iterator<U>&);
+	
+	int index() const;
+	T* base() const;
+	
+	T& operator*() const;
+	T* operator->() const;
+	T& operator[](difference_type) const;
+	
+	safe_iterator& operator++();
+	safe_iterator operator++(int);
+	safe_iterator& operator--();
+	safe_iterator operator--(int);
+	safe_iterator& operator+=(difference_type);
+	safe_iterator& operator-=(difference_type);
+	safe_iterator operator+(difference_type) const;
+	safe_iterator operator-(difference_type) const;
+	
+	template <typename U>
+	friend class safe_iterator;
+};
 
 template <typename T>
-std::istream& operator>>(std::istream&, safe_array<T>&);
+safe_iterator<T>::safe_iterator() :
+_data(nullptr), _i(0), _lo(0), _hi(-1)
+{ }
 
 template <typename T>
-void sort(safe_array<T>&, int);
+safe_iterator<T>::safe_iterator(T* data, int i, int low, int high) :
+_data(data), _i(i), _lo(low), _hi(high)
+{ }
 
 template <typename T>
-class safe_array { 
+template <typename U, typename>
+safe_iterator<T>::safe_iterator(const safe_iterator<U>& iter) :
+_data(iter._data), _i(iter._i), _lo(iter._lo), _hi(iter._hi)
+{ }
+
+template <typename T>
+inline int safe_iterator<T>::index() const {
+	return _i;
+}
+
+template <typename T>
+inline T* safe_iterator<T>::base() const {
+	return _data + (_i-_lo);
+}
+
+template <typename T>
+inline T& safe_iterator<T>::operator*() const {
+	if (SAFE_ARRAY_UNLIKELY(!safe_array_in_range(_i, _lo, _hi)))
+		safe_array_out_of_range("iterator", _i);
+
+	return _data[_i-_lo];
+}
+
+template <typename T>
+inline T* safe_iterator<T>::operator->() const {
+	return &**this;
+}
+
+template <typename T>
+inline T& safe_iterator<T>::operator[](difference_type n) const {
+	return *(*this + n);
+}
+
+template <typename T>
+inline safe_iterator<T>& safe_iterator<T>::operator++() {
+	++_i;
+	return *this;
+}
+
+template <typename T>
+inline safe_iterator<T> safe_iterator<T>::operator++(int) {
+	safe_iterator iter(*this);
+	++_i;
+	return iter;
+}
+
+template <typename T>
+inline safe_iterator<T>& safe_iterator<T>::operator--() {
+	--_i;
+	return *this;
+}
+
+template <typename T>
+inline safe_iterator<T> safe_iterator<T>::operator--(int) {
+	safe_iterator iter(*this);
+	--_i;
+	return iter;
+}
+
+template <typename T>
+inline safe_iterator<T>& safe_iterator<T>::operator+=(difference_type n) {
+	_i += static_cast<int>(n);
+	return *this;
+}
+
+template <typename T>
+inline safe_iterator<T>& safe_iterator<T>::operator-=(difference_type n) {
+	_i -= static_cast<int>(n);
+	return *this;
+}
+
+template <typename T>
+inline safe_iterator<T> safe_iterator<T>::operator+(difference_type n) const {
+	return safe_iterator(*this) += n;
+}
+
+template <typename T>
+inline safe_iterator<T> safe_iterator<T>::operator-(difference_type n) const {
+	return safe_iterator(*this) -= n;
+}
+
+template <typename T>
+inline safe_iterator<T> operator+(typename safe_iterator<T>::difference_type n, const safe_iterator<T>& iter) {
+	return iter + n;
+}
+
+template <typename T, typename U>
+inline std::ptrdiff_t operator-(const safe_iterator<T>& lhs, const safe_iterator<U>& rhs) {
+	return static_cast<std::ptrdiff_t>(lhs.index()) - rhs.index();
+}
+
+template <typename T, typename U>
+inline bool operator==(const safe_iterator<T>& lhs, const safe_iterator<U>& rhs) {
+	return lhs.index() == rhs.index();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const safe_iterator<T>& lhs, const safe_iterator<U>& rhs) {
+	return lhs.index() != rhs.index();
+}
+
+template <typename T, typename U>
+inline bool operator<(const safe_iterator<T>& lhs, const safe_iterator<U>& rhs) {
+	return lhs.index() < rhs.index();
+}
+
+template <typename T, typename U>
+inline bool operator>(const safe_iterator<T>& lhs, const safe_iterator<U>& rhs) {
+	return lhs.index() > rhs.index();
+}
+
+template <typename T, typename U>
+inline bool operator<=(const safe_iterator<T>& lhs, const safe_iterator<U>& rhs) {
+	return lhs.index() <= rhs.index();
+}
+
+template <typename T, typename U>
+inline bool operator>=(const safe_iterator<T>& lhs, const safe_iterator<U>& rhs) {
+	return lhs.index() >= rhs.index();
+}
+
+// checked iterators under a policy that checks, plain pointers otherwise
+template <typename T, typename Access>
+struct safe_array_iterator {
+	typedef typename std::conditional<Access::enabled, safe_iterator<T>, T*>::type type;
+	
+	static safe_iterator<T> make(T* data, int i, int low, int high, std::true_type) {
+		return safe_iterator<T>(data, i, low, high);
+	}
+	
+	static T* make(T* data, int i, int low, int, std::false_type) {
+		return data + (i-low);
+	}
+	
+	static type make(T* data, int i, int low, int high) {
+		return make(data, i, low, high, std::integral_constant<bool, Access::enabled>());
+	}
+};
+
+template <typename T, typename Access = SAFE_ARRAY_ACCESS>
+class safe_span {
 private:
 	int _lo, _hi;
+	T *_data;
+	
+public:
+	typedef T element_type;
+	typedef typename std::remove_cv<T>::type value_type;
+	typedef typename safe_array_iterator<T, Access>::type iterator;
+	
+	safe_span();
+	safe_span(T*, int, int);
+	
+	template <typename U, typename = typename std::enable_if
+		<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+	safe_span(const safe_span<U, Access>&);
+	
+#ifdef __cpp_lib_span
+	safe_span(std::span<T>, int=0);
+	operator std::span<T>() const;
+#endif
+	
+	int lo() const;
+	int hi() const;
+	int size() const;
+	bool empty() const;
+	T* data() const;
+	
+	iterator begin() const;
+	iterator end() const;
+	
+	T* operator+(int) const;
+	T& operator[](int) const;
+	T& at(int) const;
+	safe_span range(int, int) const;
+	safe_span rebase(int) const;
+};
+
+template <typename T, typename Access>
+safe_span<T, Access>::safe_span() :
+_lo(0), _hi(-1), _data(nullptr)
+{ }
+
+template <typename T, typename Access>
+safe_span<T, Access>::safe_span(T* data, int low, int high) :
+_lo(low), _hi(high), _data(data)
+{ }
+
+template <typename T, typename Access>
+template <typename U, typename>
+safe_span<T, Access>::safe_span(const safe_span<U, Access>& ss) :
+_lo( ss.lo() ), _hi( ss.hi() ), _data( ss.data() )
+{ }
+
+#ifdef __cpp_lib_span
+template <typename T, typename Access>
+safe_span<T, Access>::safe_span(std::span<T> ss, int low) :
+_lo(low), _hi(low + static_cast<int>(ss.size()) - 1), _data( ss.data() )
+{ }
+
+template <typename T, typename Access>
+safe_span<T, Access>::operator std::span<T>() const {
+	return std::span<T>(_data, size());
+}
+#endif
+
+template <typename T, typename Access>
+inline int safe_span<T, Access>::lo() const {
+	return _lo;
+}
+
+template <typename T, typename Access>
+inline int safe_span<T, Access>::hi() const {
+	return _hi;
+}
+
+template <typename T, typename Access>
+inline int safe_span<T, Access>::size() const {
+	return _hi-_lo+1;
+}
+
+template <typename T, typename Access>
+inline bool safe_span<T, Access>::empty() const {
+	return _hi < _lo;
+}
+
+template <typename T, typename Access>
+inline T* safe_span<T, Access>::data() const {
+	return _data;
+}
+
+template <typename T, typename Access>
+inline typename safe_span<T, Access>::iterator safe_span<T, Access>::begin() const {
+	return safe_array_iterator<T, Access>::make(_data, _lo, _lo, _hi);
+}
+
+template <typename T, typename Access>
+inline typename safe_span<T, Access>::iterator safe_span<T, Access>::end() const {
+	return safe_array_iterator<T, Access>::make(_data, _hi+1, _lo, _hi);
+}
+
+template <typename T, typename Access>
+inline T* safe_span<T, Access>::operator+(int offset) const {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(offset, _lo, _hi)))
+		safe_array_out_of_range("offset", offset);
+
+	return _data + (offset-_lo);
+}
+
+template <typename T, typename Access>
+inline T& safe_span<T, Access>::operator[](int i) const {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, _lo, _hi)))
+		safe_array_out_of_range("index", i);
+
+	return _data[i-_lo];
+}
+
+template <typename T, typename Access>
+inline T& safe_span<T, Access>::at(int i) const {
+	if (SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, _lo, _hi)))
+		safe_array_out_of_range("index", i);
+
+	return _data[i-_lo];
+}
+
+template <typename T, typename Access>
+safe_span<T, Access> safe_span<T, Access>::range(int low, int high) const {
+	safe_array_check_range<Access>(low, high, _lo, _hi);
+	
+	return low <= high ? safe_span(_data + (low-_lo), low, high)
+	                   : safe_span(_data, low, low-1);
+}
+
+template <typename T, typename Access>
+safe_span<T, Access> safe_span<T, Access>::rebase(int low) const {
+	return safe_span(_data, low, low + size() - 1);
+}
+
+template <typename T, std::size_t Align = 64>
+class aligned_allocator {
+public:
+	typedef T value_type;
+	
+	static constexpr std::size_t alignment = 
+		Align > alignof(T) && Align > sizeof(void*) ? Align : 
+		alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*);
+	
+	template <typename U>
+	struct rebind {
+		typedef aligned_allocator<U, Align> other;
+	};
+	
+	aligned_allocator() = default;
+	
+	template <typename U>
+	aligned_allocator(const aligned_allocator<U, Align>&);
+	
+	T* allocate(std::size_t);
+	void deallocate(T*, std::size_t);
+};
+
+template <typename T, std::size_t Align>
+constexpr std::size_t aligned_allocator<T, Align>::alignment;
+
+template <typename T, std::size_t Align>
+template <typename U>
+aligned_allocator<T, Align>::aligned_allocator(const aligned_allocator<U, Align>&)
+{ }
+
+template <typename T, std::size_t Align>
+T* aligned_allocator<T, Align>::allocate(std::size_t n) {
+	if (n > static_cast<std::size_t>(-1) / sizeof(T))
+		throw std::bad_alloc();
+	
+	std::size_t bytes = n ? n * sizeof(T) : alignment;
+	void *ptr = nullptr;
+	
+#ifdef _MSC_VER
+	ptr = _aligned_malloc(bytes, alignment);
+#else
+	if (posix_memalign(&ptr, alignment, bytes) != 0)
+		ptr = nullptr;
+#endif
+	
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+	
+	return static_cast<T*>(ptr);
+}
+
+template <typename T, std::size_t Align>
+void aligned_allocator<T, Align>::deallocate(T* ptr, std::size_t) {
+#ifdef _MSC_VER
+	_aligned_free(ptr);
+#else
+	std::free(ptr);
+#endif
+}
+
+template <typename T, std::size_t A, typename U, std::size_t B>
+inline bool operator==(const aligned_allocator<T, A>&, const aligned_allocator<U, B>&) {
+	return A == B;
+}
+
+template <typename T, std::size_t A, typename U, std::size_t B>
+inline bool operator!=(const aligned_allocator<T, A>&, const aligned_allocator<U, B>&) {
+	return A != B;
+}
+
+inline int safe_array_checked_size(int low, int high) {
+	int size = high-low+1;
+	if (size <= 0)
+		throw std::length_error
+		(
+			"invalid bounds: " + std::to_string(size)
+		);
+	
+	return size;
+}
+
+template <typename T>
+inline void safe_array_destroy(T* arr, int from, int to) {
+	if (!std::is_trivially_destructible<T>::value)
+		for (int i = from; i < to; ++i)
+			arr[i].~T();
+}
+
+template <typename T>
+void safe_array_construct(T* arr, int from, int to) {
+	if (std::is_trivially_default_constructible<T>::value)
+		return;
+	
+	int i = from;
+	try {
+		for (; i < to; ++i)
+			::new (static_cast<void*>(arr + i)) T;
+	} catch (...) {
+		safe_array_destroy(arr, from, i);
+		throw;
+	}
+}
+
+template <typename T>
+void safe_array_fill(T* arr, int from, int to, const T& value) {
+	int i = from;
+	try {
+		for (; i < to; ++i)
+			::new (static_cast<void*>(arr + i)) T(value);
+	} catch (...) {
+		safe_array_destroy(arr, from, i);
+		throw;
+	}
+}
+
+template <typename T>
+inline void safe_array_copy(const T* src, T* dst, int size, std::true_type) {
+	if (size > 0)
+		std::memcpy(static_cast<void*>(dst), src, sizeof(T) * size);
+}
+
+template <typename T>
+inline void safe_array_copy(const T* src, T* dst, int size, std::false_type) {
+	std::uninitialized_copy(src, src + size, dst);
+}
+
+template <typename T>
+inline void safe_array_copy(const T* src, T* dst, int size) {
+	safe_array_copy(src, dst, size, std::is_trivially_copyable<T>());
+}
+
+template <typename T>
+inline void safe_array_relocate(T* src, T* dst, int size, std::true_type) {
+	safe_array_copy(src, dst, size, std::true_type());
+}
+
+template <typename T>
+void safe_array_relocate(T* src, T* dst, int size, std::false_type) {
+	typedef typename std::conditional
+	<
+		std::is_nothrow_move_constructible<T>::value || !std::is_copy_constructible<T>::value,
+		std::move_iterator<T*>, T*
+	>::type source;
+	
+	std::uninitialized_copy(source(src), source(src + size), dst);
+}
+
+template <typename T>
+inline void safe_array_relocate(T* src, T* dst, int size) {
+	safe_array_relocate(src, dst, size, std::is_trivially_copyable<T>());
+}
+
+template <typename T, typename Access = SAFE_ARRAY_ACCESS, typename Alloc = aligned_allocator<T>> 
+class safe_array;
+
+template <typename T, typename Access, typename Alloc>
+std::ostream& operator<<(std::ostream&, const safe_array<T, Access, Alloc>&);
+
+template <typename T, typename Access, typename Alloc>
+std::istream& operator>>(std::istream&, safe_array<T, Access, Alloc>&);
+
+template <typename T, typename Access, typename Alloc>
+void sort(safe_array<T, Access, Alloc>&, int);
+
+template <typename T, typename Access, typename Alloc>
+class safe_array { 
+private:
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<T> allocator_type;
+	typedef std::allocator_traits<allocator_type> alloc_traits;
+	
+	int _lo, _hi, _cap;
+	allocator_type _alloc;
 	T *_arr;
 	
-	T* arr_cp() const;
+	T* arr_cp(const T*, int);
+	bool in_range(int) const;
+	int grow() const;
+	void check_resize(int) const;
+	
+	T* allocate(int);
+	void deallocate(T*, int);
+	void release();
+	void adopt(T*, int);
+	void reallocate(int);
+	void take(safe_array&);
+	void copy_alloc(const allocator_type&, std::true_type);
+	void copy_alloc(const allocator_type&, std::false_type);
+	void move_assign(safe_array&, std::true_type);
+	void move_assign(safe_array&, std::false_type);
+	
 	
 public:
+	typedef T value_type;
+	typedef typename safe_array_iterator<T, Access>::type iterator;
+	typedef typename safe_array_iterator<const T, Access>::type const_iterator;
+	typedef safe_span<T, Access> span_type;
+	typedef safe_span<const T, Access> const_span_type;
+	
 	safe_array();
+	explicit safe_array(const Alloc&);
 	safe_array(int);
-	safe_array(int, int);
+	safe_array(int, int, const Alloc& = Alloc());
 	safe_array(std::initializer_list<T>);
 	safe_array(const safe_array&);
 	safe_array(safe_array&&);
@@ -39,155 +622,505 @@ public:
 	const T* operator+(int) const;
 	T& operator[](int);
 	const T& operator[](int) const;
+	T& at(int);
+	const T& at(int) const;
+	
+	int lo() const;
+	int hi() const;
+	int size() const;
+	int capacity() const;
+	bool empty() const;
+	T* data();
+	const T* data() const;
+	Alloc get_allocator() const;
+	
+	void reserve(int);
+	void resize(int);
+	void resize(int, const T&);
+	void push_back(const T&);
+	void push_back(T&&);
+	
+	template <typename... Args>
+	T& emplace_back(Args&&...);
+	
+	iterator begin();
+	iterator end();
+	const_iterator begin() const;
+	const_iterator end() const;
+	const_iterator cbegin() const;
+	const_iterator cend() const;
+	
+	span_type span();
+	const_span_type span() const;
+	span_type range(int, int);
+	const_span_type range(int, int) const;
+	operator span_type();
+	operator const_span_type() const;
+	
 	safe_array& operator=(const safe_array&);
 	safe_array& operator=(safe_array&&);
 	
 	~safe_array();
 	
 	friend std::ostream& 
-	operator<< <T> (std::ostream&, const safe_array<T>&);
+	operator<< <T, Access, Alloc> (std::ostream&, const safe_array<T, Access, Alloc>&);
 	
 	friend std::istream& 
-	operator>> <T> (std::istream&, safe_array<T>&);
+	operator>> <T, Access, Alloc> (std::istream&, safe_array<T, Access, Alloc>&);
 	
-	friend void sort<T>(safe_array<T>&, int);
+	friend void sort<T, Access, Alloc>(safe_array<T, Access, Alloc>&, int);
 };
 
-template <typename T>
-T* safe_array<T>::arr_cp() const {
-	if (_arr == nullptr) 
+template <typename T, typename Access, typename Alloc>
+T* safe_array<T, Access, Alloc>::arr_cp(const T* src, int size) {
+	if (src == nullptr) 
 		return nullptr;
 
-	int size = _hi-_lo+1;
-	T *r_array = new T[size];
-	for (int i = 0; i < size; ++i)
-		r_array[i] = _arr[i];
-		
-	return r_array;
+	T *arr = allocate(size);
+	try {
+		safe_array_copy(src, arr, size);
+	} catch (...) {
+		deallocate(arr, size);
+		throw;
+	}
+	
+	return arr;
 }
 
-template <typename T>
-safe_array<T>::safe_array() :
-_lo(0), _hi(-1), _arr(nullptr)
-{ }
+template <typename T, typename Access, typename Alloc>
+inline bool safe_array<T, Access, Alloc>::in_range(int i) const {
+	return safe_array_in_range(i, _lo, _hi);
+}
 
-template <typename T>
-safe_array<T>::safe_array(int sz) :
-safe_array(0, sz-1)
-{ }
+template <typename T, typename Access, typename Alloc>
+int safe_array<T, Access, Alloc>::grow() const {
+	if (_cap == INT_MAX)
+		throw std::length_error
+		(
+			"capacity overflow"
+		);
+	
+	return _cap < 4 ? 4 : _cap > INT_MAX/2 ? INT_MAX : 2*_cap;
+}
 
-template <typename T>
-safe_array<T>::safe_array(int low, int high) :
-_lo(low), _hi(high)
-{
-	int size = _hi-_lo+1;
-	if (size <= 0)
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::check_resize(int n) const {
+	if (n < 0 || static_cast<long long>(_lo) + n - 1 > INT_MAX)
 		throw std::length_error
 		(
-			"invalid bounds: " + std::to_string(size)
+			"invalid size: " + std::to_string(n)
 		);
+}
+
+template <typename T, typename Access, typename Alloc>
+inline T* safe_array<T, Access, Alloc>::allocate(int size) {
+	return alloc_traits::allocate(_alloc, size);
+}
+
+template <typename T, typename Access, typename Alloc>
+inline void safe_array<T, Access, Alloc>::deallocate(T* arr, int size) {
+	alloc_traits::deallocate(_alloc, arr, size);
+}
+
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::release() {
+	if (_arr == nullptr)
+		return;
 	
-	_arr = new T[size];
+	safe_array_destroy(_arr, 0, size());
+	deallocate(_arr, _cap);
 }
 
-template <typename T>
-safe_array<T>::safe_array(std::initializer_list<T> il) :
-safe_array(0, il.size()-1)
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::adopt(T* arr, int cap) {
+	release();
+	_arr = arr;
+	_cap = cap;
+}
+
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::reallocate(int cap) {
+	T *arr = allocate(cap);
+	try {
+		safe_array_relocate(_arr, arr, size());
+	} catch (...) {
+		deallocate(arr, cap);
+		throw;
+	}
+	
+	adopt(arr, cap);
+}
+
+// takes over the buffer and bounds of sa, which is left empty
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::take(safe_array& sa) {
+	adopt(sa._arr, sa._cap);
+	_lo = sa._lo;
+	_hi = sa._hi;
+	
+	sa._arr = nullptr;
+	sa._lo = 0;
+	sa._hi = -1;
+	sa._cap = 0;
+}
+
+// the buffer must go back to the allocator that made it before that allocator is replaced
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::copy_alloc(const allocator_type& alloc, std::true_type) {
+	if (_alloc != alloc) {
+		adopt(nullptr, 0);
+		_lo = 0;
+		_hi = -1;
+	}
+	
+	_alloc = alloc;
+}
+
+template <typename T, typename Access, typename Alloc>
+inline void safe_array<T, Access, Alloc>::copy_alloc(const allocator_type&, std::false_type) 
+{ }
+
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::move_assign(safe_array& rhs, std::true_type) {
+	adopt(nullptr, 0);
+	_alloc = std::move(rhs._alloc);
+	take(rhs);
+}
+
+// an allocator that stays behind can only take the buffer if it could free it;
+// otherwise the elements move one by one into storage of its own
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::move_assign(safe_array& rhs, std::false_type) {
+	if (_alloc == rhs._alloc) {
+		take(rhs);
+		return;
+	}
+	
+	int n = rhs.size();
+	T *arr = n > 0 ? allocate(n) : nullptr;
+	try {
+		safe_array_relocate(rhs._arr, arr, n);
+	} catch (...) {
+		deallocate(arr, n);
+		throw;
+	}
+	
+	adopt(arr, n);
+	_lo = rhs._lo;
+	_hi = rhs._hi;
+	
+	rhs.adopt(nullptr, 0);
+	rhs._lo = 0;
+	rhs._hi = -1;
+}
+
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::safe_array() :
+_lo(0), _hi(-1), _cap(0), _arr(nullptr)
+{ }
+
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::safe_array(const Alloc& alloc) :
+_lo(0), _hi(-1), _cap(0), _alloc(alloc), _arr(nullptr)
+{ }
+
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::safe_array(int sz) :
+safe_array(0, sz-1)
+{ }
+
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::safe_array(int low, int high, const Alloc& alloc) :
+_lo(low), _hi(high), _cap( safe_array_checked_size(low, high) ), _alloc(alloc), _arr( allocate(_cap) )
 {
-	int i = 0;
-	for (auto& elmt: il)
-		_arr[i++] = std::move(elmt);
+	try {
+		safe_array_construct(_arr, 0, _cap);
+	} catch (...) {
+		deallocate(_arr, _cap);
+		throw;
+	}
 }
 
-template <typename T>
-safe_array<T>::safe_array(const safe_array& sa) :
-_hi(sa._hi), _lo(sa._lo), _arr( sa.arr_cp() )
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::safe_array(std::initializer_list<T> il) :
+_lo(0), _hi(static_cast<int>(il.size())-1), _cap( safe_array_checked_size(0, _hi) ), _arr( arr_cp(il.begin(), _cap) )
 { }
 
-template <typename T>
-safe_array<T>::safe_array(safe_array&& sa) :
-_hi(sa._hi), _lo(sa._lo), _arr(sa._arr) 
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::safe_array(const safe_array& sa) :
+_lo(sa._lo), _hi(sa._hi), _cap( sa.size() ),
+_alloc( alloc_traits::select_on_container_copy_construction(sa._alloc) ), _arr( arr_cp(sa._arr, _cap) )
+{ }
+
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::safe_array(safe_array&& sa) :
+_lo(sa._lo), _hi(sa._hi), _cap(sa._cap), _alloc( std::move(sa._alloc) ), _arr(sa._arr)
 {
 	sa._arr = nullptr;
 	sa._lo = 0;
 	sa._hi = -1;
+	sa._cap = 0;
 }
 
-template <typename T>
-T* safe_array<T>::operator+(int offset) {
-	if (offset < _lo || offset > _hi)
-		throw std::out_of_range
-		(
-			"offset " + std::to_string(offset) + " out of range"
-		);
+template <typename T, typename Access, typename Alloc>
+T* safe_array<T, Access, Alloc>::operator+(int offset) {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!in_range(offset)))
+		safe_array_out_of_range("offset", offset);
 
 	return _arr + (offset-_lo);
 }
 
-template <typename T>
-const T* safe_array<T>::operator+(int offset) const {
-	if (offset < _lo || offset > _hi)
-		throw std::out_of_range
-		(
-			"offset " + std::to_string(offset) + " out of range"
-		);
+template <typename T, typename Access, typename Alloc>
+const T* safe_array<T, Access, Alloc>::operator+(int offset) const {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!in_range(offset)))
+		safe_array_out_of_range("offset", offset);
 
 	return _arr + (offset-_lo);
 }
 
-template <typename T>
-T& safe_array<T>::operator[](int i) {
-	if (i < _lo || i > _hi)
-		throw std::out_of_range
-		(
-			"index " + std::to_string(i) + " out of range"
-		);
+template <typename T, typename Access, typename Alloc>
+T& safe_array<T, Access, Alloc>::operator[](int i) {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!in_range(i)))
+		safe_array_out_of_range("index", i);
+	
+	return _arr[i-_lo];
+}
 
+template <typename T, typename Access, typename Alloc>
+const T& safe_array<T, Access, Alloc>::operator[](int i) const {
+	if (Access::enabled && SAFE_ARRAY_UNLIKELY(!in_range(i)))
+		safe_array_out_of_range("index", i);
+	
 	return _arr[i-_lo];
 }
 
-template <typename T>
-const T& safe_array<T>::operator[](int i) const {
-	if (i < _lo || i > _hi)
-		throw std::out_of_range
-		(
-			"index " + std::to_string(i) + " out of range"
-		);
+template <typename T, typename Access, typename Alloc>
+T& safe_array<T, Access, Alloc>::at(int i) {
+	if (SAFE_ARRAY_UNLIKELY(!in_range(i)))
+		safe_array_out_of_range("index", i);
 	
 	return _arr[i-_lo];
 }
 
-template <typename T>
-safe_array<T>& safe_array<T>::operator=(const safe_array& rhs) {
-	if (this != &rhs) {
-		delete []_arr;
-		_arr = rhs.arr_cp();
-		_lo = rhs._lo;
-		_hi = rhs._hi;
-	}
+template <typename T, typename Access, typename Alloc>
+const T& safe_array<T, Access, Alloc>::at(int i) const {
+	if (SAFE_ARRAY_UNLIKELY(!in_range(i)))
+		safe_array_out_of_range("index", i);
 	
-	return *this;
+	return _arr[i-_lo];
 }
 
-template <typename T>
-safe_array<T>& safe_array<T>::operator=(safe_array&& rhs) {
-	if (this != &rhs) {
-		T *tmp = _arr;
-		_arr = rhs._arr;
-		rhs._arr = tmp;
+template <typename T, typename Access, typename Alloc>
+inline int safe_array<T, Access, Alloc>::lo() const {
+	return _lo;
+}
+
+template <typename T, typename Access, typename Alloc>
+inline int safe_array<T, Access, Alloc>::hi() const {
+	return _hi;
+}
+
+template <typename T, typename Access, typename Alloc>
+inline int safe_array<T, Access, Alloc>::size() const {
+	return _hi-_lo+1;
+}
+
+template <typename T, typename Access, typename Alloc>
+inline int safe_array<T, Access, Alloc>::capacity() const {
+	return _cap;
+}
+
+template <typename T, typename Access, typename Alloc>
+inline bool safe_array<T, Access, Alloc>::empty() const {
+	return _hi < _lo;
+}
+
+template <typename T, typename Access, typename Alloc>
+inline Alloc safe_array<T, Access, Alloc>::get_allocator() const {
+	return Alloc(_alloc);
+}
+
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::reserve(int cap) {
+	if (cap > _cap)
+		reallocate(cap);
+}
+
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::resize(int n) {
+	check_resize(n);
+	if (n > _cap)
+		reallocate(n);
+	
+	if (n > size())
+		safe_array_construct(_arr, size(), n);
+	else
+		safe_array_destroy(_arr, n, size());
+	
+	_hi = _lo + n - 1;
+}
+
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::resize(int n, const T& value) {
+	check_resize(n);
+	if (n > _cap) {
+		T tmp(value);
+		reallocate(n);
+		safe_array_fill(_arr, size(), n, tmp);
+	} else if (n > size())
+		safe_array_fill(_arr, size(), n, value);
+	else
+		safe_array_destroy(_arr, n, size());
+	
+	_hi = _lo + n - 1;
+}
+
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::push_back(const T& value) {
+	emplace_back(value);
+}
+
+template <typename T, typename Access, typename Alloc>
+void safe_array<T, Access, Alloc>::push_back(T&& value) {
+	emplace_back( std::move(value) );
+}
+
+template <typename T, typename Access, typename Alloc>
+template <typename... Args>
+T& safe_array<T, Access, Alloc>::emplace_back(Args&&... args) {
+	int n = size();
+	check_resize(n + 1);
+	
+	if (n < _cap)
+		::new (static_cast<void*>(_arr + n)) T( std::forward<Args>(args)... );
+	else {
+		int cap = grow();
+		T *arr = allocate(cap);
 		
-		_lo = rhs._lo;
-		rhs._lo = 0;
+		try {
+			::new (static_cast<void*>(arr + n)) T( std::forward<Args>(args)... );
+		} catch (...) {
+			deallocate(arr, cap);
+			throw;
+		}
+		
+		try {
+			safe_array_relocate(_arr, arr, n);
+		} catch (...) {
+			arr[n].~T();
+			deallocate(arr, cap);
+			throw;
+		}
 		
-		_hi = rhs._hi;
-		rhs._hi = -1;
+		adopt(arr, cap);
 	}
 	
+	++_hi;
+	return _arr[n];
+}
+
+template <typename T, typename Access, typename Alloc>
+inline T* safe_array<T, Access, Alloc>::data() {
+	return _arr;
+}
+
+template <typename T, typename Access, typename Alloc>
+inline const T* safe_array<T, Access, Alloc>::data() const {
+	return _arr;
+}
+
+template <typename T, typename Access, typename Alloc>
+inline typename safe_array<T, Access, Alloc>::iterator safe_array<T, Access, Alloc>::begin() {
+	return safe_array_iterator<T, Access>::make(_arr, _lo, _lo, _hi);
+}
+
+template <typename T, typename Access, typename Alloc>
+inline typename safe_array<T, Access, Alloc>::iterator safe_array<T, Access, Alloc>::end() {
+	return safe_array_iterator<T, Access>::make(_arr, _hi+1, _lo, _hi);
+}
+
+template <typename T, typename Access, typename Alloc>
+inline typename safe_array<T, Access, Alloc>::const_iterator safe_array<T, Access, Alloc>::begin() const {
+	return safe_array_iterator<const T, Access>::make(_arr, _lo, _lo, _hi);
+}
+
+template <typename T, typename Access, typename Alloc>
+inline typename safe_array<T, Access, Alloc>::const_iterator safe_array<T, Access, Alloc>::end() const {
+	return safe_array_iterator<const T, Access>::make(_arr, _hi+1, _lo, _hi);
+}
+
+template <typename T, typename Access, typename Alloc>
+inline typename safe_array<T, Access, Alloc>::const_iterator safe_array<T, Access, Alloc>::cbegin() const {
+	return begin();
+}
+
+template <typename T, typename Access, typename Alloc>
+inline typename safe_array<T, Access, Alloc>::const_iterator safe_array<T, Access, Alloc>::cend() const {
+	return end();
+}
+
+template <typename T, typename Access, typename Alloc>
+safe_span<T, Access> safe_array<T, Access, Alloc>::span() {
+	return span_type(_arr, _lo, _hi);
+}
+
+template <typename T, typename Access, typename Alloc>
+safe_span<const T, Access> safe_array<T, Access, Alloc>::span() const {
+	return const_span_type(_arr, _lo, _hi);
+}
+
+template <typename T, typename Access, typename Alloc>
+safe_span<T, Access> safe_array<T, Access, Alloc>::range(int low, int high) {
+	return span().range(low, high);
+}
+
+template <typename T, typename Access, typename Alloc>
+safe_span<const T, Access> safe_array<T, Access, Alloc>::range(int low, int high) const {
+	return span().range(low, high);
+}
+
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::operator safe_span<T, Access>() {
+	return span();
+}
+
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::operator safe_span<const T, Access>() const {
+	return span();
+}
+
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>& safe_array<T, Access, Alloc>::operator=(const safe_array& rhs) {
+	if (this == &rhs)
+		return *this;
+	
+	copy_alloc(rhs._alloc, typename alloc_traits::propagate_on_container_copy_assignment());
+	if (_arr == nullptr || size() != rhs.size()) {
+		adopt(arr_cp(rhs._arr, rhs.size()), rhs.size());
+	} else if (std::is_trivially_copyable<T>::value)
+		safe_array_copy(rhs._arr, _arr, size(), std::true_type());
+	else
+		std::copy(rhs._arr, rhs._arr + size(), _arr);
+	
+	_lo = rhs._lo;
+	_hi = rhs._hi;
+	
 	return *this;
 }
 
-template <typename T>
-std::ostream& operator<<(std::ostream& out, const safe_array<T>& sa) {
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>& safe_array<T, Access, Alloc>::operator=(safe_array&& rhs) {
+	if (this != &rhs)
+		move_assign(rhs, typename alloc_traits::propagate_on_container_move_assignment());
+	
+	return *this;
+}
+
+template <typename T, typename Access, typename Alloc>
+std::ostream& operator<<(std::ostream& out, const safe_array<T, Access, Alloc>& sa) {
+	if (sa.empty())
+		return out;
+	
 	int end = sa._hi-sa._lo;
 	for (int i = 0; i < end; ++i)
 		out << sa._arr[i] << ' ';
@@ -196,39 +1129,26 @@ std::ostream& operator<<(std::ostream& out, const safe_array<T>& sa) {
 	return out;
 }
 
-template <typename T>
-std::istream& operator>>(std::istream& in, safe_array<T>& sa) {
+template <typename T, typename Access, typename Alloc>
+std::istream& operator>>(std::istream& in, safe_array<T, Access, Alloc>& sa) {
 	for (int i = 0, end = sa._hi-sa._lo; i <= end; ++i)
 		in >> sa._arr[i];
 	
 	return in;
 }
 
-template <typename T>
-void sort(safe_array<T>& sa, int sz) {
-	auto swap = [](T& x, T& y) {
-		T tmp( std::move(x) );
-		x = std::move(y);
-		y = std::move(tmp);
-	};
-
+template <typename T, typename Access, typename Alloc>
+void sort(safe_array<T, Access, Alloc>& sa, int sz) {
 	int size = sa._hi-sa._lo+1;
-	int cap = sz > size ? size : sz, i = 0;
-	T *arr = sa._arr;
-	
-	while (i < cap) {
-		if (i == 0 || arr[i-1] <= arr[i])
-			++i;
-		else {
-			swap(arr[i-1], arr[i]);
-			--i;
-		}
-	}
+	int cap = sz > size ? size : sz;
+	
+	if (cap > 1)
+		safe_sort::sort(sa._arr, sa._arr + cap);
 }
 
-template <typename T>
-safe_array<T>::~safe_array() {
-	delete []_arr;
+template <typename T, typename Access, typename Alloc>
+safe_array<T, Access, Alloc>::~safe_array() {
+	release();
 }
 
 #endif
@@ -6,10 +6,15 @@
 #include <utility>
 #include <stdexcept>
 #include <string>
+#include <cstddef>
+#include <climits>
+#include <algorithm>
 #include "safe_array.h"
-
-template<typename T>
-class safe_matrix;
+#include "thread_pool.h"
+#include "gemm.h"
+#include "matrix_expr.h"
+#include "matrix_view.h"
+#include "fixed_matrix.h"
 
 template<typename T>
 std::ostream& operator<<(std::ostream&, const safe_matrix<T>&);
@@ -17,32 +22,106 @@ std::ostream& operator<<(std::ostream&, const safe_matrix<T>&);
 template<typename T>
 std::istream& operator>>(std::istream&, safe_matrix<T>&);
 
+// one 64-byte aligned row-major buffer; rows are padded out to a whole number
+// of cache lines when that costs at most an eighth of the row
 template <typename T>
-class safe_matrix {
+class safe_matrix<T, safe_matrix_dynamic, safe_matrix_dynamic, 0, 0> : public matrix_expr< safe_matrix<T> > {
 private:
-	int _r_lo, _r_hi, _c_lo, _c_hi;
-	safe_array<safe_array<T>> _mat;
+	int _r_lo, _r_hi, _c_lo, _c_hi, _stride;
+	safe_array<T> _mat;
+	
+	static int padded(int);
+	T* row_ptr(int);
+	const T* row_ptr(int) const;
 	
 public:
+	typedef T value_type;
+	typedef safe_span<T> row_type;
+	typedef safe_span<const T> const_row_type;
+	typedef matrix_view<T> view_type;
+	typedef matrix_view<const T> const_view_type;
+	
 	safe_matrix(int=0);
 	safe_matrix(int, int);
 	safe_matrix(int, int, int, int);
+	safe_matrix(const safe_matrix&);
 	safe_matrix(safe_matrix&&);
 	
-	safe_matrix operator+(const safe_matrix&) const; 
-	safe_matrix operator-(const safe_matrix&) const; 
-	safe_matrix operator*(const safe_matrix&) const; 
-	safe_array<T>& operator[](int);
-	const safe_array<T>& operator[](int) const;
+	template <typename E>
+	safe_matrix(const matrix_expr<E>&);
+	
+	int row_lo() const;
+	int row_hi() const;
+	int col_lo() const;
+	int col_hi() const;
+	int rows() const;
+	int cols() const;
+	int stride() const;
+	T* data();
+	const T* data() const;
+	
+	view_type view();
+	const_view_type view() const;
+	view_type block(int, int, int, int);
+	const_view_type block(int, int, int, int) const;
+	view_type row(int);
+	const_view_type row(int) const;
+	view_type col(int);
+	const_view_type col(int) const;
+	view_type transposed();
+	const_view_type transposed() const;
+	
+	safe_matrix transpose() const;
+	safe_matrix& transpose_in_place();
+	row_type operator[](int);
+	const_row_type operator[](int) const;
+	T& operator()(int, int);
+	const T& operator()(int, int) const;
+	safe_matrix& operator=(const safe_matrix&);
 	safe_matrix& operator=(safe_matrix&&);
 	
-	friend std::ostream& 
+	template <typename E>
+	safe_matrix& operator=(const matrix_expr<E>&);
+	
+	template <typename E>
+	safe_matrix& operator+=(const matrix_expr<E>&);
+	
+	template <typename E>
+	safe_matrix& operator-=(const matrix_expr<E>&);
+	
+	safe_matrix& operator*=(const T&);
+	
+	friend std::ostream&
 	operator<< <T>(std::ostream&, const safe_matrix<T>&);
 	
 	friend std::istream&
 	operator>> <T>(std::istream&, safe_matrix<T>&);
 };
 
+template <typename T>
+int safe_matrix<T>::padded(int cols) {
+	const int line = 64 % sizeof(T) == 0 ? 64 / sizeof(T) : 1;
+	int stride = (cols + line-1) / line * line;
+	
+	return stride - cols <= cols / 8 ? stride : cols;
+}
+
+template <typename T>
+inline T* safe_matrix<T>::row_ptr(int i) {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, _r_lo, _r_hi)))
+		safe_array_out_of_range("row", i);
+	
+	return _mat.data() + static_cast<std::ptrdiff_t>(i-_r_lo) * _stride;
+}
+
+template <typename T>
+inline const T* safe_matrix<T>::row_ptr(int i) const {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(i, _r_lo, _r_hi)))
+		safe_array_out_of_range("row", i);
+	
+	return _mat.data() + static_cast<std::ptrdiff_t>(i-_r_lo) * _stride;
+}
+
 template <typename T>
 safe_matrix<T>::safe_matrix(int dim) :
 safe_matrix(0, dim-1, 0, dim-1)
@@ -55,80 +134,319 @@ safe_matrix(0, rows-1, 0, cols-1)
 
 template <typename T>
 safe_matrix<T>::safe_matrix(int i1, int i2, int j1, int j2) :
-_r_lo(i1), _r_hi(i2), _c_lo(j1), _c_hi(j2)
+_r_lo(i1), _r_hi(i2), _c_lo(j1), _c_hi(j2), _stride(0)
 {
 	int row_size = _r_hi-_r_lo+1, col_size = _c_hi-_c_lo+1;
-	if (row_size <= 0 || col_size <= 0) 
+	if (row_size <= 0 || col_size <= 0)
 		throw std::length_error
 		(
-			"invalid bounds. row size: " + std::to_string(row_size) 
+			"invalid bounds. row size: " + std::to_string(row_size)
 			+ ", column size: " + std::to_string(col_size)
 		);
 	
-	_mat = safe_array<safe_array<T>>(_r_lo, _r_hi);
-	for (int i = _r_lo; i <= _r_hi; ++i)
-		_mat[i] = safe_array<T>(_c_lo, _c_hi);
+	_stride = padded(col_size);
+	if (static_cast<long long>(row_size) * _stride > INT_MAX)
+		throw std::length_error
+		(
+			"matrix too large: " + std::to_string(row_size) + " x " + std::to_string(col_size)
+		);
+	
+	_mat = safe_array<T>(row_size * _stride);
 }
 
+template <typename T>
+safe_matrix<T>::safe_matrix(const safe_matrix& sm) :
+_r_lo(sm._r_lo), _r_hi(sm._r_hi), _c_lo(sm._c_lo),
+_c_hi(sm._c_hi), _stride(sm._stride), _mat(sm._mat)
+{ }
+
 template <typename T>
 safe_matrix<T>::safe_matrix(safe_matrix&& sm) :
-_r_lo(sm._r_lo), _r_hi(sm._r_hi), _c_lo(sm._c_lo), 
-_c_hi(sm._c_hi), _mat( std::move(sm._mat) )
+_r_lo(sm._r_lo), _r_hi(sm._r_hi), _c_lo(sm._c_lo),
+_c_hi(sm._c_hi), _stride(sm._stride), _mat( std::move(sm._mat) )
 { }
 
+// a 0-based matrix of the expression's shape
+template <typename T>
+template <typename E>
+safe_matrix<T>::safe_matrix(const matrix_expr<E>& e) :
+safe_matrix(e.self().rows(), e.self().cols())
+{
+	safe_matrix_eval(data(), _stride, 1, e.self(), matrix_assign());
+}
+
+template <typename T>
+inline int safe_matrix<T>::row_lo() const {
+	return _r_lo;
+}
+
+template <typename T>
+inline int safe_matrix<T>::row_hi() const {
+	return _r_hi;
+}
+
+template <typename T>
+inline int safe_matrix<T>::col_lo() const {
+	return _c_lo;
+}
+
+template <typename T>
+inline int safe_matrix<T>::col_hi() const {
+	return _c_hi;
+}
+
+template <typename T>
+inline int safe_matrix<T>::rows() const {
+	return _r_hi-_r_lo+1;
+}
+
+template <typename T>
+inline int safe_matrix<T>::cols() const {
+	return _c_hi-_c_lo+1;
+}
+
+template <typename T>
+inline int safe_matrix<T>::stride() const {
+	return _stride;
+}
+
+template <typename T>
+inline T* safe_matrix<T>::data() {
+	return _mat.data();
+}
+
+template <typename T>
+inline const T* safe_matrix<T>::data() const {
+	return _mat.data();
+}
+
+template <typename T>
+inline matrix_view<T> safe_matrix<T>::view() {
+	return view_type(data(), _r_lo, _r_hi, _c_lo, _c_hi, _stride, 1);
+}
+
+template <typename T>
+inline matrix_view<const T> safe_matrix<T>::view() const {
+	return const_view_type(data(), _r_lo, _r_hi, _c_lo, _c_hi, _stride, 1);
+}
+
+// views of rows i1..i2 and columns j1..j2, indexed as they are here
+template <typename T>
+matrix_view<T> safe_matrix<T>::block(int i1, int i2, int j1, int j2) {
+	return view().block(i1, i2, j1, j2);
+}
+
+template <typename T>
+matrix_view<const T> safe_matrix<T>::block(int i1, int i2, int j1, int j2) const {
+	return view().block(i1, i2, j1, j2);
+}
+
+template <typename T>
+matrix_view<T> safe_matrix<T>::row(int i) {
+	return view().row(i);
+}
+
+template <typename T>
+matrix_view<const T> safe_matrix<T>::row(int i) const {
+	return view().row(i);
+}
+
+template <typename T>
+matrix_view<T> safe_matrix<T>::col(int j) {
+	return view().col(j);
+}
+
+template <typename T>
+matrix_view<const T> safe_matrix<T>::col(int j) const {
+	return view().col(j);
+}
+
+// transposed() is a view; transpose() copies
+template <typename T>
+matrix_view<T> safe_matrix<T>::transposed() {
+	return view().transposed();
+}
+
 template <typename T>
-safe_matrix<T> safe_matrix<T>::operator+(const safe_matrix& sm) const {
-	int this_rsize = _r_hi-_r_lo+1, this_csize = _c_hi-_c_lo+1;
-	int othr_rsize = sm._r_hi-sm._r_lo+1, othr_csize = sm._c_hi-sm._c_lo+1;
+matrix_view<const T> safe_matrix<T>::transposed() const {
+	return view().transposed();
+}
+
+// keeps the bounds, swapped
+template <typename T>
+safe_matrix<T> safe_matrix<T>::transpose() const {
+	safe_matrix<T> r_sm(_c_lo, _c_hi, _r_lo, _r_hi);
+	safe_matrix_copy(transposed(), r_sm.data(), r_sm._stride, 1);
 	
-	if (this_rsize != othr_rsize || this_csize != othr_csize) 
-		throw std::length_error
-		(
-			"matrix dimension mismatch"
-		);
+	return r_sm;
+}
+
+// square matrices are transposed where they lie, tile pair by tile pair;
+// any other shape needs a new row stride and goes through transpose()
+template <typename T>
+safe_matrix<T>& safe_matrix<T>::transpose_in_place() {
+	int n = rows();
+	if (n != cols())
+		return *this = transpose();
 	
-	safe_matrix<T> r_sm(this_rsize, this_csize);
+	const int tile = 256;
+	int tiles = (n + tile-1) / tile;
+	T *a = data();
+	std::ptrdiff_t ld = _stride;
 	
-	int this_i = _r_lo, othr_i = sm._r_lo;
-	for (int i = 0; i < this_rsize; ++i, ++this_i, ++othr_i) {
-		int this_j = _c_lo, othr_j = sm._c_lo;
-		for (int j = 0; j < this_csize; ++j, ++this_j, ++othr_j) {
-			r_sm[i][j] = _mat[this_i][this_j] + sm._mat[othr_i][othr_j];
-		}
+	thread_pool::shared().parallel_for(tiles * tiles, [=](int t) {
+		int ib = t / tiles * tile, jb = t % tiles * tile;
+		int ni = std::min(tile, n - ib), nj = std::min(tile, n - jb);
+		
+		if (ib == jb)
+			safe_matrix_transpose_square(ni, a + ib*ld + ib, ld);
+		else if (ib < jb)
+			safe_matrix_swap_transposed(ni, nj, a + ib*ld + jb, a + jb*ld + ib, ld);
+	});
+	
+	std::swap(_r_lo, _c_lo);
+	std::swap(_r_hi, _c_hi);
+	return *this;
+}
+
+template <typename T>
+safe_span<T> safe_matrix<T>::operator[](int i) {
+	return row_type(row_ptr(i), _c_lo, _c_hi);
+}
+
+template <typename T>
+safe_span<const T> safe_matrix<T>::operator[](int i) const {
+	return const_row_type(row_ptr(i), _c_lo, _c_hi);
+}
+
+template <typename T>
+T& safe_matrix<T>::operator()(int i, int j) {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(j, _c_lo, _c_hi)))
+		safe_array_out_of_range("column", j);
+	
+	return row_ptr(i)[j-_c_lo];
+}
+
+template <typename T>
+const T& safe_matrix<T>::operator()(int i, int j) const {
+	if (SAFE_ARRAY_ACCESS::enabled && SAFE_ARRAY_UNLIKELY(!safe_array_in_range(j, _c_lo, _c_hi)))
+		safe_array_out_of_range("column", j);
+	
+	return row_ptr(i)[j-_c_lo];
+}
+
+// the buffer is reused when the shapes match
+template <typename T>
+safe_matrix<T>& safe_matrix<T>::operator=(const safe_matrix& sm) {
+	if (this == &sm)
+		return *this;
+	if (sm.rows() != rows() || sm.cols() != cols())
+		return *this = safe_matrix<T>(sm);
+	
+	_r_lo = sm._r_lo;
+	_c_lo = sm._c_lo;
+	_r_hi = sm._r_hi;
+	_c_hi = sm._c_hi;
+	std::copy(sm.data(), sm.data() + sm._mat.size(), data());
+	
+	return *this;
+}
+
+template <typename T>
+safe_matrix<T>& safe_matrix<T>::operator=(safe_matrix&& sm) {
+	if (this != &sm) {
+		_r_lo = sm._r_lo;
+		_c_lo = sm._c_lo;
+		_r_hi = sm._r_hi;
+		_c_hi = sm._c_hi;
+		_stride = sm._stride;
+		std::swap(_mat, sm._mat);
 	}
 	
-	return r_sm;
+	return *this;
 }
 
+// same shape: evaluated in place and the bounds are kept; otherwise this
+// becomes a 0-based matrix of the expression's shape
 template <typename T>
-safe_matrix<T> safe_matrix<T>::operator-(const safe_matrix& sm) const {
-	int this_rsize = _r_hi-_r_lo+1, this_csize = _c_hi-_c_lo+1;
-	int othr_rsize = sm._r_hi-sm._r_lo+1, othr_csize = sm._c_hi-sm._c_lo+1;
+template <typename E>
+safe_matrix<T>& safe_matrix<T>::operator=(const matrix_expr<E>& e) {
+	if (e.self().rows() != rows() || e.self().cols() != cols())
+		return *this = safe_matrix<T>(e);
 	
-	if (this_rsize != othr_rsize || this_csize != othr_csize)
+	safe_matrix_eval(data(), _stride, 1, e.self(), matrix_assign());
+	return *this;
+}
+
+template <typename T>
+template <typename E>
+safe_matrix<T>& safe_matrix<T>::operator+=(const matrix_expr<E>& e) {
+	if (e.self().rows() != rows() || e.self().cols() != cols())
 		throw std::length_error
 		(
 			"matrix dimension mismatch"
 		);
 	
-	safe_matrix<T> r_sm(this_rsize, this_csize);
-	
-	int this_i = _r_lo, othr_i = sm._r_lo;
-	for (int i = 0; i < this_rsize; ++i, ++this_i, ++othr_i) {
-		int this_j = _c_lo, othr_j = sm._c_lo;
-		for (int j = 0; j < this_csize; ++j, ++this_j, ++othr_j) {
-			r_sm[i][j] = _mat[this_i][this_j] - sm._mat[othr_i][othr_j];
-		}
-	}
+	safe_matrix_eval(data(), _stride, 1, e.self(), matrix_add_assign());
+	return *this;
+}
+
+template <typename T>
+template <typename E>
+safe_matrix<T>& safe_matrix<T>::operator-=(const matrix_expr<E>& e) {
+	if (e.self().rows() != rows() || e.self().cols() != cols())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
 	
-	return r_sm;
+	safe_matrix_eval(data(), _stride, 1, e.self(), matrix_sub_assign());
+	return *this;
 }
 
 template <typename T>
-safe_matrix<T> safe_matrix<T>::operator*(const safe_matrix& sm) const {
-	int this_rsize = _r_hi-_r_lo+1, this_csize = _c_hi-_c_lo+1;
-	int othr_rsize = sm._r_hi-sm._r_lo+1, othr_csize = sm._c_hi-sm._c_lo+1;
+safe_matrix<T>& safe_matrix<T>::operator*=(const T& s) {
+	safe_matrix_eval(data(), _stride, 1, *this * s, matrix_assign());
+	return *this;
+}
 
+// how one side of a product is read: matrices and views in place through
+// their strides, anything lazier evaluated into a temporary first
+template <typename E>
+class matrix_product_operand {
+private:
+	safe_matrix<typename E::value_type> _tmp;
+	
+public:
+	explicit matrix_product_operand(const E& e) : _tmp(e) { }
+	matrix_view<const typename E::value_type> view() const { return _tmp.view(); }
+};
+
+template <typename T, int R, int C, int R0, int C0>
+class matrix_product_operand< safe_matrix<T, R, C, R0, C0> > {
+private:
+	matrix_view<const T> _view;
+	
+public:
+	explicit matrix_product_operand(const safe_matrix<T, R, C, R0, C0>& sm) : _view(sm.view()) { }
+	matrix_view<const T> view() const { return _view; }
+};
+
+template <typename T>
+class matrix_product_operand< matrix_view<T> > {
+private:
+	matrix_view<const typename matrix_view<T>::value_type> _view;
+	
+public:
+	explicit matrix_product_operand(const matrix_view<T>& mv) : _view(mv) { }
+	matrix_view<const typename matrix_view<T>::value_type> view() const { return _view; }
+};
+
+template <typename T>
+safe_matrix<T> safe_matrix_product(const matrix_view<const T>& a, const matrix_view<const T>& b) {
+	int this_rsize = a.rows(), this_csize = a.cols();
+	int othr_rsize = b.rows(), othr_csize = b.cols();
+	
 	if (this_csize != othr_rsize)
 		throw std::length_error
 		(
@@ -136,54 +454,133 @@ safe_matrix<T> safe_matrix<T>::operator*(const safe_matrix& sm) const {
 		);
 	
 	safe_matrix<T> r_sm(this_rsize, othr_csize);
-	
-	for (int i = 0, this_i = _r_lo; i < this_rsize; ++i, ++this_i) {
-		for (int j = 0, othr_j = sm._c_lo; j < othr_csize; ++j, ++othr_j) {
-			r_sm[i][j] = 0;
-			int this_j = _c_lo, othr_i = sm._r_lo;
-			for (int k = 0; k < this_csize; ++k, ++this_j, ++othr_i) {
-				r_sm[i][j] += _mat[this_i][this_j] * sm._mat[othr_i][othr_j];
-			}
-		}
-	}
+	safe_gemm::multiply(thread_pool::shared(), this_rsize, othr_csize, this_csize,
+	                    a.data(), a.row_stride(), a.col_stride(),
+	                    b.data(), b.row_stride(), b.col_stride(), r_sm.data(), r_sm.stride());
 	
 	return r_sm;
 }
 
-template <typename T>
-safe_array<T>& safe_matrix<T>::operator[](int i) {
-	return _mat[i];
+// a 0-based result. only lazy operands such as A + B are evaluated first;
+// matrices, blocks and transposed views go to gemm as they are
+template <typename L, typename R>
+safe_matrix<typename L::value_type> operator*(const matrix_expr<L>& lhs, const matrix_expr<R>& rhs) {
+	matrix_product_operand<L> a(lhs.self());
+	matrix_product_operand<R> b(rhs.self());
+	
+	return safe_matrix_product(a.view(), b.view());
 }
 
 template <typename T>
-const safe_array<T>& safe_matrix<T>::operator[](int i) const {
-	return _mat[i];
+T safe_matrix_dot(const T* a, std::ptrdiff_t inc, const T* x, int n) {
+	T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int j = 0;
+	
+	// four partial sums keep the adds from serialising on one register
+	for (; j + 4 <= n; j += 4) {
+		s0 += a[j*inc] * x[j];
+		s1 += a[(j+1)*inc] * x[j+1];
+		s2 += a[(j+2)*inc] * x[j+2];
+		s3 += a[(j+3)*inc] * x[j+3];
+	}
+	for (; j < n; ++j)
+		s0 += a[j*inc] * x[j];
+	
+	return (s0 + s1) + (s2 + s3);
 }
 
-template <typename T>
-safe_matrix<T>& safe_matrix<T>::operator=(safe_matrix&& sm) {
-	if (this != &sm) {
-		_r_lo = sm._r_lo;
-		_c_lo = sm._c_lo;
-		_r_hi = sm._r_hi;
-		_c_hi = sm._c_hi;
-		std::swap(_mat, sm._mat);
+template <typename E, typename T>
+safe_array<T> operator*(const matrix_expr<E>& lhs, const safe_array<T>& sa) {
+	matrix_product_operand<E> op(lhs.self());
+	matrix_view<const T> a = op.view();
+	int this_rsize = a.rows(), this_csize = a.cols();
+	
+	if (this_csize != sa.size())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+	
+	safe_array<T> r_sa(this_rsize);
+	const T *x = sa.data();
+	T *y = r_sa.data();
+	std::ptrdiff_t rs = a.row_stride(), cs = a.col_stride();
+	int grain = std::max(1, safe_matrix_parallel_min / this_csize);
+	
+	thread_pool::shared().parallel_range(this_rsize, grain, [&](int lo, int hi) {
+		for (int i = lo; i < hi; ++i) {
+			const T *row = a.data() + i*rs;
+			y[i] = cs == 1 ? safe_matrix_dot(row, 1, x, this_csize) : safe_matrix_dot(row, cs, x, this_csize);
+		}
+	});
+	
+	return r_sa;
+}
+
+// C = alpha * A * B + beta * C as a single pass over C. with beta == 0 the old
+// contents of C are never read. C may be a view, even a transposed one; when
+// it shares memory with A or B the product goes through a temporary
+template <typename L, typename R, typename T>
+void gemm(const typename matrix_view<T>::value_type& alpha, const matrix_expr<L>& lhs,
+          const matrix_expr<R>& rhs, const typename matrix_view<T>::value_type& beta, matrix_view<T> c)
+{
+	matrix_product_operand<L> x(lhs.self());
+	matrix_product_operand<R> y(rhs.self());
+	matrix_view<const T> a = x.view(), b = y.view();
+	
+	if (a.cols() != b.rows() || c.rows() != a.rows() || c.cols() != b.cols())
+		throw std::length_error
+		(
+			"matrix dimension mismatch"
+		);
+	
+	if (safe_matrix_overlap(c, a) || safe_matrix_overlap(c, b) || (c.col_stride() != 1 && c.row_stride() != 1)) {
+		safe_matrix<T> ab = safe_matrix_product(a, b);
+		if (beta == T(0))
+			c = alpha * ab;
+		else
+			c = alpha * ab + beta * c;
+		return;
 	}
 	
-	return *this;
+	// a column-major C is filled as C' = B' A'
+	if (c.col_stride() == 1)
+		safe_gemm::gemm(thread_pool::shared(), a.rows(), b.cols(), a.cols(), alpha,
+		                a.data(), a.row_stride(), a.col_stride(),
+		                b.data(), b.row_stride(), b.col_stride(), beta, c.data(), c.row_stride());
+	else
+		safe_gemm::gemm(thread_pool::shared(), b.cols(), a.rows(), a.cols(), alpha,
+		                b.data(), b.col_stride(), b.row_stride(),
+		                a.data(), a.col_stride(), a.row_stride(), beta, c.data(), c.col_stride());
+}
+
+template <typename L, typename R, typename T>
+void gemm(const typename safe_matrix<T>::value_type& alpha, const matrix_expr<L>& lhs,
+          const matrix_expr<R>& rhs, const typename safe_matrix<T>::value_type& beta, safe_matrix<T>& c)
+{
+	gemm(alpha, lhs, rhs, beta, c.view());
 }
 
 template <typename T>
 std::ostream& operator<<(std::ostream& out, const safe_matrix<T>& sm) {
-	for (int i = sm._r_lo, end = sm._r_hi; i <= end; ++i)
-		out << sm._mat[i] << '\n';
-		
+	for (int i = sm._r_lo, end = sm._r_hi; i <= end; ++i) {
+		const T *row = sm.row_ptr(i);
+		for (int j = 0, cols = sm.cols(); j < cols; ++j)
+			out << row[j] << (j+1 < cols ? ' ' : '\n');
+	}
+	
 	return out;
 }
 
 template <typename T>
-std::istream& operator>>(std::istream& in, safe_matrix<T>& sm) {	
-	return in >> sm._mat;
+std::istream& operator>>(std::istream& in, safe_matrix<T>& sm) {
+	for (int i = sm._r_lo, end = sm._r_hi; i <= end; ++i) {
+		T *row = sm.row_ptr(i);
+		for (int j = 0, cols = sm.cols(); j < cols; ++j)
+			in >> row[j];
+	}
+	
+	return in;
 }
 
 #endif
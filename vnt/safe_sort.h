@@ -0,0 +1,417 @@
+#ifndef SAFE_SORT
+#define SAFE_SORT
+
+#include <utility>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <limits>
+#include <type_traits>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+namespace safe_sort {
+
+const std::ptrdiff_t network_max = 16;
+const std::ptrdiff_t insertion_max = 24;
+const std::ptrdiff_t ninther_min = 128;
+const std::ptrdiff_t radix_min = 256;
+const std::ptrdiff_t parallel_min = std::ptrdiff_t(1) << 20;
+
+// the original gnome sort only required operator<=, so ordering is derived from it.
+// NaN compares false against everything, which is no strict weak ordering and
+// runs the unguarded partition loops off the array, so floating point puts
+// NaNs last instead
+struct less_equal_order {
+	template <typename T>
+	bool operator()(const T& x, const T& y) const { return less(x, y, std::is_floating_point<T>()); }
+
+	template <typename T>
+	static bool less(const T& x, const T& y, std::false_type) { return !(y <= x); }
+
+	template <typename T>
+	static bool less(const T& x, const T& y, std::true_type) { return x == x && (y != y || x < y); }
+};
+
+template <typename T>
+struct use_network : std::integral_constant<bool,
+	std::is_arithmetic<T>::value && !std::is_same<T, bool>::value> { };
+
+template <typename T>
+struct use_radix : std::integral_constant<bool,
+	(std::is_integral<T>::value && !std::is_same<T, bool>::value)
+	|| ((std::is_same<T, float>::value || std::is_same<T, double>::value)
+		&& std::numeric_limits<T>::is_iec559)> { };
+
+template <std::size_t N> struct radix_word;
+template <> struct radix_word<1> { typedef std::uint8_t type; };
+template <> struct radix_word<2> { typedef std::uint16_t type; };
+template <> struct radix_word<4> { typedef std::uint32_t type; };
+template <> struct radix_word<8> { typedef std::uint64_t type; };
+
+template <typename T>
+inline void compare_exchange(T& x, T& y) {
+	T a = x, b = y;
+	bool swap = less_equal_order()(b, a);
+	x = swap ? b : a;
+	y = swap ? a : b;
+}
+
+// Batcher's odd-even merge network; the comparison sequence is fixed for a
+// given n, so the body is branch-free and the compiler lowers it to min/max
+template <typename T>
+void network_sort(T* arr, std::ptrdiff_t n) {
+	for (std::ptrdiff_t p = 1; p < n; p <<= 1)
+		for (std::ptrdiff_t k = p; k >= 1; k >>= 1)
+			for (std::ptrdiff_t j = k % p; j + k < n; j += 2*k)
+				for (std::ptrdiff_t i = 0; i < k && i + j + k < n; ++i)
+					if ((i+j) / (2*p) == (i+j+k) / (2*p))
+						compare_exchange(arr[i+j], arr[i+j+k]);
+}
+
+template <typename T, typename Comp>
+void insertion_sort(T* first, T* last, Comp comp) {
+	if (first == last) return;
+
+	for (T *cur = first + 1; cur < last; ++cur) {
+		if (comp(*cur, *(cur-1))) {
+			T tmp( std::move(*cur) );
+			T *sift = cur;
+
+			do {
+				*sift = std::move(*(sift-1));
+				--sift;
+			} while (sift != first && comp(tmp, *(sift-1)));
+
+			*sift = std::move(tmp);
+		}
+	}
+}
+
+template <typename T, typename Comp>
+bool partial_insertion_sort(T* first, T* last, Comp comp) {
+	if (first == last) return true;
+	std::ptrdiff_t moves = 0;
+
+	for (T *cur = first + 1; cur < last; ++cur) {
+		if (comp(*cur, *(cur-1))) {
+			T tmp( std::move(*cur) );
+			T *sift = cur;
+
+			do {
+				*sift = std::move(*(sift-1));
+				--sift;
+			} while (sift != first && comp(tmp, *(sift-1)));
+
+			*sift = std::move(tmp);
+			if ((moves += cur - sift) > 8) return false;
+		}
+	}
+
+	return true;
+}
+
+template <typename T, typename Comp>
+void small_sort(T* first, T* last, Comp comp, std::true_type) {
+	if (last - first <= network_max)
+		network_sort(first, last - first);
+	else
+		insertion_sort(first, last, comp);
+}
+
+template <typename T, typename Comp>
+void small_sort(T* first, T* last, Comp comp, std::false_type) {
+	insertion_sort(first, last, comp);
+}
+
+template <typename T, typename Comp>
+inline void sort3(T* a, T* b, T* c, Comp comp) {
+	using std::swap;
+	if (comp(*b, *a)) swap(*a, *b);
+	if (comp(*c, *b)) swap(*b, *c);
+	if (comp(*b, *a)) swap(*a, *b);
+}
+
+template <typename T, typename Comp>
+std::pair<T*, bool> partition_right(T* first, T* last, Comp comp) {
+	using std::swap;
+	T pivot( std::move(*first) );
+	T *lo = first, *hi = last;
+
+	while (comp(*++lo, pivot))
+		;
+
+	if (lo - 1 == first)
+		while (lo < hi && !comp(*--hi, pivot))
+			;
+	else
+		while (!comp(*--hi, pivot))
+			;
+
+	bool partitioned = lo >= hi;
+	while (lo < hi) {
+		swap(*lo, *hi);
+		while (comp(*++lo, pivot))
+			;
+		while (!comp(*--hi, pivot))
+			;
+	}
+
+	T *pivot_pos = lo - 1;
+	*first = std::move(*pivot_pos);
+	*pivot_pos = std::move(pivot);
+
+	return std::make_pair(pivot_pos, partitioned);
+}
+
+template <typename T, typename Comp>
+T* partition_left(T* first, T* last, Comp comp) {
+	using std::swap;
+	T pivot( std::move(*first) );
+	T *lo = first, *hi = last;
+
+	while (comp(pivot, *--hi))
+		;
+
+	if (hi + 1 == last)
+		while (lo < hi && !comp(pivot, *++lo))
+			;
+	else
+		while (!comp(pivot, *++lo))
+			;
+
+	while (lo < hi) {
+		swap(*lo, *hi);
+		while (comp(pivot, *--hi))
+			;
+		while (!comp(pivot, *++lo))
+			;
+	}
+
+	*first = std::move(*hi);
+	*hi = std::move(pivot);
+
+	return hi;
+}
+
+template <typename T, typename Comp>
+void pdq_loop(T* first, T* last, Comp comp, int bad_allowed, bool leftmost) {
+	using std::swap;
+
+	for (;;) {
+		std::ptrdiff_t size = last - first;
+		if (size < insertion_max) {
+			small_sort(first, last, comp, use_network<T>());
+			return;
+		}
+
+		std::ptrdiff_t s2 = size / 2;
+		if (size > ninther_min) {
+			sort3(first, first + s2, last - 1, comp);
+			sort3(first + 1, first + (s2-1), last - 2, comp);
+			sort3(first + 2, first + (s2+1), last - 3, comp);
+			sort3(first + (s2-1), first + s2, first + (s2+1), comp);
+			swap(*first, *(first + s2));
+		} else
+			sort3(first + s2, first, last - 1, comp);
+
+		if (!leftmost && !comp(*(first-1), *first)) {
+			first = partition_left(first, last, comp) + 1;
+			continue;
+		}
+
+		std::pair<T*, bool> part = partition_right(first, last, comp);
+		T *pivot_pos = part.first;
+		std::ptrdiff_t l_size = pivot_pos - first, r_size = last - (pivot_pos + 1);
+
+		if (l_size < size / 8 || r_size < size / 8) {
+			if (--bad_allowed == 0) {
+				std::make_heap(first, last, comp);
+				std::sort_heap(first, last, comp);
+				return;
+			}
+
+			if (l_size >= insertion_max) {
+				swap(first[0], first[l_size/4]);
+				swap(pivot_pos[-1], pivot_pos[-l_size/4]);
+			}
+
+			if (r_size >= insertion_max) {
+				swap(pivot_pos[1], pivot_pos[1 + r_size/4]);
+				swap(last[-1], last[-r_size/4]);
+			}
+		} else if (part.second
+			&& partial_insertion_sort(first, pivot_pos, comp)
+			&& partial_insertion_sort(pivot_pos + 1, last, comp))
+			return;
+
+		pdq_loop(first, pivot_pos, comp, bad_allowed, leftmost);
+		first = pivot_pos + 1;
+		leftmost = false;
+	}
+}
+
+template <typename T, typename Comp>
+void pdq_sort(T* first, T* last, Comp comp) {
+	std::ptrdiff_t n = last - first;
+	int log2 = 0;
+	while (n >>= 1) ++log2;
+
+	pdq_loop(first, last, comp, log2 + 1, true);
+}
+
+template <typename T>
+typename radix_word<sizeof(T)>::type radix_key(const T& x) {
+	typedef typename radix_word<sizeof(T)>::type word;
+	const word top = word(1) << (sizeof(T)*8 - 1);
+
+	word bits;
+	std::memcpy(&bits, &x, sizeof(T));
+
+	// NaNs sort last, whatever their sign
+	if (std::is_floating_point<T>::value)
+		return x != x ? word(~word(0)) : bits & top ? word(~bits) : word(bits ^ top);
+
+	return std::is_signed<T>::value ? word(bits ^ top) : bits;
+}
+
+template <typename T>
+void radix_sort(T* first, T* last) {
+	std::size_t n = last - first;
+	std::vector<T> buffer(n);
+	T *src = first, *dst = buffer.data();
+
+	for (std::size_t shift = 0; shift < sizeof(T)*8; shift += 8) {
+		std::size_t count[256] = { };
+		for (std::size_t i = 0; i < n; ++i)
+			++count[(radix_key(src[i]) >> shift) & 0xff];
+
+		if (count[(radix_key(src[0]) >> shift) & 0xff] == n)
+			continue;
+
+		std::size_t sum = 0;
+		for (std::size_t& c: count) {
+			std::size_t tmp = c;
+			c = sum;
+			sum += tmp;
+		}
+
+		for (std::size_t i = 0; i < n; ++i)
+			dst[count[(radix_key(src[i]) >> shift) & 0xff]++] = src[i];
+
+		std::swap(src, dst);
+	}
+
+	if (src != first)
+		std::copy(src, src + n, first);
+}
+
+template <typename T>
+void serial_sort(T* first, T* last, std::true_type) {
+	if (last - first >= radix_min)
+		radix_sort(first, last);
+	else
+		pdq_sort(first, last, less_equal_order());
+}
+
+template <typename T>
+void serial_sort(T* first, T* last, std::false_type) {
+	pdq_sort(first, last, less_equal_order());
+}
+
+template <typename T>
+void serial_sort(T* first, T* last) {
+	serial_sort(first, last, use_radix<T>());
+}
+
+template <typename F>
+void run_threads(unsigned n, F task) {
+	std::vector<std::thread> threads;
+	threads.reserve(n - 1);
+
+	for (unsigned t = 1; t < n; ++t)
+		threads.emplace_back(task, t);
+	task(0);
+
+	for (auto& thread: threads)
+		thread.join();
+}
+
+template <typename T>
+void sample_sort(T* first, T* last, unsigned p) {
+	const std::size_t oversample = 32;
+	std::size_t n = last - first;
+	less_equal_order comp;
+
+	std::vector<T> samples;
+	samples.reserve(p * oversample);
+	for (std::size_t i = 0; i < p * oversample; ++i)
+		samples.push_back(first[i * (n / (p * oversample))]);
+	serial_sort(samples.data(), samples.data() + samples.size());
+
+	std::vector<T> splitters;
+	for (unsigned b = 1; b < p; ++b)
+		splitters.push_back(samples[b * oversample]);
+
+	std::vector<std::uint16_t> bucket(n);
+	std::vector<std::size_t> offset(p * p);
+
+	run_threads(p, [&](unsigned t) {
+		std::size_t *count = &offset[t * p];
+		for (std::size_t i = n * t / p, end = n * (t+1) / p; i < end; ++i) {
+			bucket[i] = std::upper_bound(splitters.begin(), splitters.end(), first[i], comp)
+				- splitters.begin();
+			++count[bucket[i]];
+		}
+	});
+
+	std::vector<std::size_t> bounds(p + 1);
+	std::size_t sum = 0;
+	for (unsigned b = 0; b < p; ++b) {
+		bounds[b] = sum;
+		for (unsigned t = 0; t < p; ++t) {
+			std::size_t tmp = offset[t * p + b];
+			offset[t * p + b] = sum;
+			sum += tmp;
+		}
+	}
+	bounds[p] = n;
+
+	std::vector<T> buffer(n);
+	run_threads(p, [&](unsigned t) {
+		std::size_t *next = &offset[t * p];
+		for (std::size_t i = n * t / p, end = n * (t+1) / p; i < end; ++i)
+			buffer[next[bucket[i]]++] = first[i];
+	});
+
+	run_threads(p, [&](unsigned b) {
+		T *lo = buffer.data() + bounds[b], *hi = buffer.data() + bounds[b+1];
+		serial_sort(lo, hi);
+		std::copy(lo, hi, first + bounds[b]);
+	});
+}
+
+template <typename T>
+void sort(T* first, T* last, std::true_type) {
+	unsigned p = std::thread::hardware_concurrency();
+	if (last - first >= parallel_min && p > 1)
+		sample_sort(first, last, p < 256 ? p : 256);
+	else
+		serial_sort(first, last);
+}
+
+template <typename T>
+void sort(T* first, T* last, std::false_type) {
+	serial_sort(first, last);
+}
+
+template <typename T>
+void sort(T* first, T* last) {
+	sort(first, last, std::integral_constant<bool,
+		std::is_trivially_copyable<T>::value && std::is_default_constructible<T>::value>());
+}
+
+}
+
+#endif